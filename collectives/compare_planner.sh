@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# PLANNER COMPARISON: BUILDS planner.cpp AGAINST A BASELINE REVISION AND THE WORKING TREE, RUNS BOTH ON THE SAME WORKLOAD
+# usage: ./compare_planner.sh [baseline] [numproc] [numpiece] [count]
+# e.g. ./compare_planner.sh 34fd7be^ 8 1000 64 (the baseline is the planner with lists of ranks)
+
+baseline=${1:-HEAD}
+numproc=${2:-8}
+numpiece=${3:-1000}
+count=${4:-64}
+
+CXX=${CXX:-mpicxx}
+CXXFLAGS=${CXXFLAGS:-"-std=c++14 -O3 -fopenmp"}
+MPIRUN=${MPIRUN:-"mpirun -np"}
+
+tree=$(git rev-parse --show-toplevel) || exit 1
+work=$(mktemp -d)
+trap "rm -rf $work" EXIT
+
+mkdir -p $work/baseline
+git -C $tree archive $baseline | tar -x -C $work/baseline || exit 1
+rmdir $work/baseline/CommBench 2> /dev/null
+ln -sfn $tree/CommBench $work/baseline/CommBench
+mkdir -p $work/baseline/collectives
+cp $tree/collectives/planner.cpp $work/baseline/collectives/
+
+$CXX $CXXFLAGS $work/baseline/collectives/planner.cpp -o $work/planner_baseline || exit 1
+$CXX $CXXFLAGS $tree/collectives/planner.cpp -o $work/planner || exit 1
+
+echo "baseline ($baseline):"
+$MPIRUN $numproc $work/planner_baseline $numpiece $count
+echo "working tree:"
+$MPIRUN $numproc $work/planner $numpiece $count
@@ -31,7 +31,9 @@
 
 int main(int argc, char *argv[])
 {
-  // INITIALIZE
+  // INITIALIZE (MPI_THREAD_MULTIPLE FOR HiCCL::polling, HiCCL::threaded AND REQUESTS FROM SEVERAL THREADS)
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
   CommBench::init();
   int myid = CommBench::myid;
   int numproc = CommBench::numproc;
@@ -58,6 +60,7 @@ int main(int argc, char *argv[])
   {
     printf("\n");
     printf("Number of processes: %d\n", numproc);
+    printf("MPI thread level: %d (MPI_THREAD_MULTIPLE %d)\n", provided, MPI_THREAD_MULTIPLE);
     printf("Number of warmup %d\n", warmup);
     printf("Number of iterations %d\n", numiter);
     printf("\n");
@@ -97,7 +100,7 @@ int main(int argc, char *argv[])
 
   // COLLECTIVE COMMUNICATION
   {
-    HiCCL::Comm<Type> coll;
+    HiCCL::Comm<Type> coll; // reductions accumulate in HiCCL::accumulator<Type>, e.g., HiCCL::Comm<float, double> accumulates in double
 
     HiCCL::printid = -1;    
     // PATTERN DESRIPTION
@@ -105,6 +108,7 @@ int main(int argc, char *argv[])
 	    case HiCCL::gather :
         for(int sender = 0; sender < numproc; sender++)
           coll.add_bcast(sendbuf_d, 0, recvbuf_d, sender * count, count, sender, ROOT);
+        // coll.add_gather(sendbuf_d, 0, recvbuf_d, 0, count, ROOT); // one bulk primitive, one message per subgroup on each level
         break;
       case HiCCL::scatter :
         for(int recver = 0; recver < numproc; recver++)
@@ -133,10 +137,12 @@ int main(int argc, char *argv[])
         for(int sender = 0; sender < numproc; sender++)
           for(int recver = 0; recver < numproc; recver++)
             coll.add_bcast(sendbuf_d, recver * count, recvbuf_d, sender * count, count, sender, recver);
+        // coll.add_alltoall(sendbuf_d, 0, recvbuf_d, 0, count); // one bulk primitive, messages aggregated per subgroup
         break;
       case HiCCL::allgather :
         for(int sender = 0; sender < numproc; sender++)
           coll.add_bcast(sendbuf_d, 0, recvbuf_d, sender * count, count, sender, HiCCL::all);
+        // coll.add_allgather(sendbuf_d, 0, recvbuf_d, 0, count); // one bulk primitive, messages aggregated per subgroup
         break;
       case HiCCL::reducescatter :
         for(int recver = 0; recver < numproc; recver++)
@@ -167,18 +173,47 @@ int main(int argc, char *argv[])
      //                  std::vector<CommBench::library> {CommBench::MPI, CommBench::MPI, CommBench::IPC, CommBench::IPC});
     // coll.set_hierarchy(std::vector<int> {32, 8},
     //                    std::vector<CommBench::library> {CommBench::MPI, CommBench::IPC});
+    // coll.set_threshold(std::vector<size_t> {1 << 16, 0, 0},
+    //                    std::vector<CommBench::library> {CommBench::MPI, CommBench::IPC, CommBench::IPC},
+    //                    std::vector<CommBench::library> {CommBench::XCCL, CommBench::IPC, CommBench::IPC});
+    // coll.set_compression(std::vector<bool> {true, false, false});
+    // coll.set_aggregation(std::vector<bool> {true, false, false}); // bulk all-to-all: one message per pair of nodes through proxies
+    // coll.set_incast(std::vector<int> {4, 0, 0}); // at most 4 senders per receiver and step across nodes (compare with {0, 0, 0})
+    // coll.set_quantization(std::vector<bool> {true, false, false}, HiCCL::quantize8, true);
+    // coll.set_progress(HiCCL::polling); // compare with HiCCL::ordered (default)
+    // coll.set_progress(HiCCL::threaded, std::vector<int> {1, 2, 3}); // one thread per lane pinned to cores, requires provided == MPI_THREAD_MULTIPLE
+    // coll.set_reproducible(true); // or HiCCL::measure_reproducible<Type>(warmup, numiter, count * numproc, setup) with a setup of the plan
+    // coll.set_streaming(4); // reducers receive each input in 4 pieces through double-buffered scratch
+    // coll.set_passes(std::vector<int> {HiCCL::self_copy, HiCCL::redundant_copy, HiCCL::multicast}); // optimize the schedule IR
+    // coll.set_dump("schedule.txt"); // coll.load("schedule.txt") runs an edited schedule instead of planning
+    // coll.set_stripe_weights(std::vector<double> {1, 1, 0, 2}); // per stripe (or per process), e.g., NIC bandwidth, 0 leaves a shared NIC to its peer
+    // coll.measure_stripe_weights(); // or measure the weights at init
     coll.set_numstripe(numstripe);
+    // coll.set_numstripe(std::vector<int> {numstripe, 2, 1}); // also split transfers across the dies of a node over two GPUs each
     coll.set_ringnodes(ringnodes);
     coll.set_pipedepth(pipedepth);
+    // coll.set_scheduler(HiCCL::makespan); // place batch steps by estimated cost instead of staggering, e.g., with coll.set_cost(CommBench::MPI, 5e-6, 25e9)
+    // coll.set_planner_threads(4); // plan the batches in parallel at init (the plan does not depend on the threads)
+    // coll.set_balance(true); // reduce and forward through the least-loaded senders and receivers (init reports the load per process)
+    // coll.set_local(true); // each process keeps only its own transfers and reductions (at scale, saves memory and init time)
+    // coll.set_mtu(std::vector<size_t> {1 << 22, 1 << 20, 1 << 18}, 4096); // pipeline by message size per level (page-aligned) instead of pipedepth
+    // coll.set_numbound(4); // pipelines kept for coll.run(sendbuf, recvbuf) with other buffers, the first call per pair builds one
+    // coll.set_maxcount(count); coll.set_numinstance(2); // after init, coll.set_count(n) (collective) plans n <= count once, about an init, and keeps two counts besides count
 
     CommBench::printid = -1;
     coll.init();
     CommBench::printid = 0;
 
     coll.measure(warmup, numiter, count * numproc / pipedepth);
+    // coll.measure_plan(5, std::vector<int> {1, 2, 4}); // planning time and resident memory per number of threads
 
     CommBench::report_memory();
     HiCCL::measure<Type>(warmup, numiter, count * numproc, coll);
+    // coll.report_compression();
+    // HiCCL::Request *request = coll.start(); /* overlap with other plans */ HiCCL::wait(request);
+    // HiCCL::accuracy(sendbuf_d, recvbuf_d, count * numproc, numiter, coll); // all-reduce only
+    // HiCCL::set_compute_threads(3, std::vector<int> {1, 2, 3}); // reduce (host build) and encode compressed sends on pinned threads
+    // HiCCL::measure_overlap<Type>(warmup, numiter, count * numproc, coll); // host build: synchronous vs. pooled reductions
     HiCCL::validate(sendbuf_d, recvbuf_d, count, pattern, ROOT, coll);
   }
   if(myid == CommBench::printid) {
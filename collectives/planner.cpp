@@ -0,0 +1,92 @@
+/* Copyright 2023 Stanford University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../hiccl.h"
+
+// PLANNER WORKLOAD (HOST BUILD): ALL-TO-ALL OF numpiece PIECES PER PAIR AND numpiece BROADCASTS TO OTHERS PER PROCESS.
+// REPORTS THE TIME OF init() (SLOWEST PROCESS) AND THE RESIDENT MEMORY AFTER IT (LARGEST PROCESS). IT USES ONLY THE
+// INTERFACE OF EARLIER VERSIONS, SO THAT compare_planner.sh BUILDS IT AGAINST THEM.
+
+#define Type float
+
+long resident() {
+  long size = 0;
+  long pages = 0;
+  FILE *file = fopen("/proc/self/statm", "r");
+  if(file) {
+    if(fscanf(file, "%ld %ld", &size, &pages) != 2)
+      pages = 0;
+    fclose(file);
+  }
+  return pages * sysconf(_SC_PAGESIZE);
+}
+
+int main(int argc, char *argv[])
+{
+  // INITIALIZE
+  CommBench::init();
+  int myid = CommBench::myid;
+  int numproc = CommBench::numproc;
+
+  // INPUT PARAMETERS
+  int numpiece = atoi(argv[1]);
+  size_t count = atol(argv[2]);
+
+  // ALLOCATE
+  Type *sendbuf_d;
+  Type *recvbuf_d;
+  CommBench::allocate(sendbuf_d, count * numproc * numpiece);
+  CommBench::allocate(recvbuf_d, count * numproc * numpiece);
+
+  {
+    HiCCL::Comm<Type> coll;
+
+    HiCCL::printid = -1;
+    for(int piece = 0; piece < numpiece; piece++)
+      for(int sender = 0; sender < numproc; sender++)
+        for(int recver = 0; recver < numproc; recver++)
+          coll.add_bcast(sendbuf_d, (piece * numproc + recver) * count, recvbuf_d, (piece * numproc + sender) * count, count, sender, recver);
+    coll.add_fence();
+    for(int piece = 0; piece < numpiece; piece++)
+      for(int sender = 0; sender < numproc; sender++)
+        coll.add_bcast(sendbuf_d, 0, recvbuf_d, 0, count, sender, HiCCL::others);
+
+    coll.set_hierarchy(std::vector<int> {2, 2, 2},
+                       std::vector<CommBench::library> {CommBench::MPI, CommBench::IPC, CommBench::IPC});
+    coll.set_numstripe(2);
+    coll.set_pipedepth(4);
+
+    CommBench::printid = -1;
+    MPI_Barrier(MPI_COMM_WORLD);
+    double time = MPI_Wtime();
+    coll.init();
+    time = MPI_Wtime() - time;
+    CommBench::printid = 0;
+    HiCCL::printid = 0;
+
+    long memory = resident();
+    MPI_Allreduce(MPI_IN_PLACE, &time, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &memory, 1, MPI_LONG, MPI_MAX, MPI_COMM_WORLD);
+    if(myid == CommBench::printid)
+      printf("pieces %d init %.3e s resident %.1f MB\n", numpiece, time, memory / 1e6);
+  }
+
+  // DEALLOCATE
+  CommBench::free(sendbuf_d);
+  CommBench::free(recvbuf_d);
+
+  MPI_Finalize();
+  return 0;
+} // main()
@@ -0,0 +1,147 @@
+/* Copyright 2023 Stanford University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define PORT_SYCL
+#define PORT_HIP
+// #define PORT_CUDA
+#include "../hiccl.h"
+
+// REQUESTS OF CONFLICTING PLANS FROM TWO THREADS: A GROUP ALL-TO-ALL ON A THREAD AND AN ALL-REDUCE ON THE MAIN THREAD SHARE
+// PAIRS OF PROCESSES IN RAW TRANSFERS, SO THEIR MESSAGES MATCH ONLY IF EVERY PROCESS RUNS THEM IN THE SAME ORDER (request.h)
+
+#define Type int
+
+size_t count;
+int numiter;
+int groupsize;
+Type *sendbuf_a2a;
+Type *recvbuf_a2a;
+HiCCL::Comm<Type> *alltoall;
+
+void* alltoall_thread(void *arg) {
+  long *errors = (long*) arg;
+  int myid = CommBench::myid;
+  int group = myid / groupsize;
+  std::vector<Type> sendbuf(count * groupsize);
+  std::vector<Type> recvbuf(count * groupsize);
+  for(int iter = 0; iter < numiter; iter++) {
+    for(size_t i = 0; i < sendbuf.size(); i++)
+      sendbuf[i] = iter * 1000 + myid * 10 + i % 7;
+    CommBench::memcpyH2D(sendbuf_a2a, sendbuf.data(), sendbuf.size());
+    HiCCL::Request *request = alltoall->start();
+    HiCCL::wait(request);
+    CommBench::memcpyD2H(recvbuf.data(), recvbuf_a2a, recvbuf.size());
+    for(int sender = 0; sender < groupsize; sender++)
+      for(size_t i = 0; i < count; i++)
+        if(recvbuf[sender * count + i] != iter * 1000 + (group * groupsize + sender) * 10 + ((myid % groupsize) * count + i) % 7)
+          (*errors)++;
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  // INITIALIZE (REQUESTS FROM SEVERAL THREADS REQUIRE MPI_THREAD_MULTIPLE)
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+  CommBench::init();
+  int myid = CommBench::myid;
+  int numproc = CommBench::numproc;
+
+  // INPUT PARAMETERS
+  count = atol(argv[1]);
+  groupsize = atoi(argv[2]);
+  numiter = atoi(argv[3]);
+
+  if(myid == CommBench::printid) {
+    printf("\n");
+    printf("Number of processes: %d\n", numproc);
+    printf("Thread level: %d (MPI_THREAD_MULTIPLE %d)\n", provided, MPI_THREAD_MULTIPLE);
+    printf("count %ld group size %d iterations %d\n", count, groupsize, numiter);
+  }
+  if(provided < MPI_THREAD_MULTIPLE || numproc % groupsize) {
+    if(myid == CommBench::printid)
+      printf("ERROR!!! requires MPI_THREAD_MULTIPLE and a group size that divides the number of processes\n");
+    MPI_Finalize();
+    return 0;
+  }
+
+  // ALLOCATE
+  Type *sendbuf_d;
+  Type *recvbuf_d;
+  CommBench::allocate(sendbuf_d, count * numproc);
+  CommBench::allocate(recvbuf_d, count * numproc);
+  CommBench::allocate(sendbuf_a2a, count * groupsize);
+  CommBench::allocate(recvbuf_a2a, count * groupsize);
+
+  long errors = 0;
+  long errors_a2a = 0;
+  {
+    HiCCL::Comm<Type> allreduce;
+    HiCCL::Comm<Type> group;
+
+    HiCCL::printid = -1;
+    // REDUCE-SCATTER + ALL-GATHER OVER ALL PROCESSES
+    for(int recver = 0; recver < numproc; recver++)
+      allreduce.add_reduce(sendbuf_d, recver * count, recvbuf_d, recver * count, count, HiCCL::all, recver);
+    allreduce.add_fence();
+    for(int sender = 0; sender < numproc; sender++)
+      allreduce.add_bcast(recvbuf_d, sender * count, recvbuf_d, sender * count, count, sender, HiCCL::others);
+    // ALL-TO-ALL WITHIN EACH GROUP OF PROCESSES
+    for(int g = 0; g < numproc / groupsize; g++)
+      for(int sender = 0; sender < groupsize; sender++)
+        for(int recver = 0; recver < groupsize; recver++)
+          group.add_bcast(sendbuf_a2a, recver * count, recvbuf_a2a, sender * count, count, g * groupsize + sender, g * groupsize + recver);
+    HiCCL::printid = 0;
+
+    // INITIALIZE IN THE SAME ORDER ON EVERY PROCESS
+    CommBench::printid = -1;
+    allreduce.init();
+    group.init();
+    CommBench::printid = 0;
+
+    alltoall = &group;
+    pthread_t thread;
+    pthread_create(&thread, NULL, alltoall_thread, &errors_a2a);
+
+    std::vector<Type> sendbuf(count * numproc);
+    std::vector<Type> recvbuf(count * numproc);
+    for(int iter = 0; iter < numiter; iter++) {
+      for(size_t i = 0; i < sendbuf.size(); i++)
+        sendbuf[i] = iter + myid + i % 5;
+      CommBench::memcpyH2D(sendbuf_d, sendbuf.data(), sendbuf.size());
+      HiCCL::Request *request = allreduce.start();
+      HiCCL::wait(request);
+      CommBench::memcpyD2H(recvbuf.data(), recvbuf_d, recvbuf.size());
+      for(size_t i = 0; i < recvbuf.size(); i++)
+        if(recvbuf[i] != numproc * (iter + i % 5) + numproc * (numproc - 1) / 2)
+          errors++;
+    }
+    pthread_join(thread, NULL);
+  }
+  errors += errors_a2a;
+  MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  if(myid == CommBench::printid)
+    printf("%s: %ld errors over %d iterations\n", errors ? "FAILED" : "PASSED", errors, numiter);
+
+  // DEALLOCATE
+  CommBench::free(sendbuf_d);
+  CommBench::free(recvbuf_d);
+  CommBench::free(sendbuf_a2a);
+  CommBench::free(recvbuf_a2a);
+
+  MPI_Finalize();
+  return 0;
+} // main()
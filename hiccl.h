@@ -22,9 +22,32 @@
 // For SYCL: #define PORT_SYCL
 
 #include "CommBench/commbench.h"
+#ifdef PORT_CUDA
+#include <cuda_fp16.h>
+#include <cuda_bf16.h>
+#elif defined PORT_HIP
+#include <hip/hip_fp16.h>
+#include <hip/hip_bf16.h>
+#endif
 
 #include <list>
+#include <map>
+#include <set>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <cmath>
+#include <type_traits>
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <climits>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <limits>
 
 namespace HiCCL {
 
@@ -33,18 +56,36 @@ namespace HiCCL {
   static const int &numproc = CommBench::numproc;
   static const int &myid = CommBench::myid;
 
-  static size_t buffsize = 0;
-  static size_t recycle = 0;
-  static size_t reuse = 0;
+  static std::atomic<size_t> buffsize(0);
+  static std::atomic<size_t> recycle(0);
+  static std::atomic<size_t> reuse(0);
+
+  // OPTIONS OF A PLAN, PASSED DOWN THE PLANNER (PLANS OF SEVERAL Comm OBJECTS AND THEIR BATCHES MAY RUN ON THREADS AT ONCE)
+  struct Options {
+    bool parametric = false; // keep empty pieces so that the plan structure does not depend on the count
+    int streaming = 0; // pieces per input of a streaming receive-reduce (0: inputs are received whole)
+    bool local = false; // processes keep only the transfers and computations they take part in
+    std::vector<double> stripe_weight; // share of each process in striped inter-node primitives (empty: equal split)
+  };
 
   enum pattern {all, others};
   enum collective {dummy, gather, scatter, broadcast, reduce, alltoall, allgather, reducescatter, allreduce};
+  enum codec {raw, lossless, quantize8, bfloat16};
 
+#include "source/memory.h"
+#include "source/ranks.h"
+#include "source/precision.h"
 #include "source/compute.h"
+#include "source/compress.h"
 #include "source/coll.h"
+#include "source/schedule.h"
+#include "source/makespan.h"
 #include "source/command.h"
+#include "source/request.h"
+#include "source/progress.h"
 #include "source/reduce.h"
 #include "source/broadcast.h"
+#include "source/bulk.h"
 // #include "source/init.h"
 #include "source/comm.h"
 #include "source/bench.h"
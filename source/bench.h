@@ -1,5 +1,5 @@
-template <typename T>
-void measure(int warmup, int numiter, size_t count, Comm<T> &comm) {
+template <typename T, typename A>
+void measure(int warmup, int numiter, size_t count, Comm<T, A> &comm) {
 
   double times[numiter];
   if(myid == printid)
@@ -59,6 +59,46 @@ void measure(int warmup, int numiter, size_t count, Comm<T> &comm) {
   }
 }
 
+// OVERLAP OF COMMUNICATION WITH HOST REDUCTIONS: SYNCHRONOUS (IN THE CALLING THREAD) VS. THE COMPUTE THREAD POOL
+template <typename T, typename A>
+void measure_overlap(int warmup, int numiter, size_t count, Comm<T, A> &comm) {
+#if defined PORT_CUDA || defined PORT_HIP || defined PORT_SYCL
+  if(myid == printid)
+    printf("device reductions run asynchronously on streams, nothing to compare\n");
+#else
+  int numthread_user = host_threads();
+  int numthread = numthread_user;
+  std::vector<int> cores = host_cores;
+  if(numthread == 0)
+    numthread = std::max(host_numcore() - 1, 1);
+  double medTime[2];
+  for(int async = 0; async < 2; async++) {
+    set_compute_threads(async ? numthread : 0, cores);
+    std::vector<double> times(numiter);
+    for(int iter = -warmup; iter < numiter; iter++) {
+      MPI_Barrier(comm_mpi);
+      double time = MPI_Wtime();
+      comm.run();
+      time = MPI_Wtime() - time;
+      MPI_Allreduce(MPI_IN_PLACE, &time, 1, MPI_DOUBLE, MPI_MAX, comm_mpi);
+      if(iter > -1)
+        times[iter] = time;
+    }
+    std::sort(times.begin(), times.end());
+    medTime[async] = times[numiter / 2];
+  }
+  if(numthread_user != numthread)
+    set_compute_threads(numthread_user, cores);
+  if(myid == printid) {
+    double data = count * sizeof(T);
+    printf("host reductions synchronous medTime: %.4e us, %.4e GB/s\n", medTime[0] * 1e6, data / medTime[0] / 1e9);
+    printf("host reductions on %d threads medTime: %.4e us, %.4e GB/s\n", numthread, medTime[1] * 1e6, data / medTime[1] / 1e9);
+    printf("overlap speedup: %.2f\n", medTime[0] / medTime[1]);
+    printf("\n");
+  }
+#endif
+}
+
 template <typename T, typename Comm>
 void validate(T *sendbuf_d, T *recvbuf_d, size_t count, int patternid, int root, Comm &comm) {
 
@@ -226,3 +266,95 @@ void validate(T *sendbuf_d, T *recvbuf_d, size_t count, int patternid, int root,
 #endif
 }
 
+// ACCURACY VERSUS BANDWIDTH OF AN ALL-REDUCE WITH count ELEMENTS (e.g., WITH QUANTIZATION)
+// Each iteration reduces fresh random data and compares with an exact (double) reduction. The accumulated error is that of
+// the sum of results over iterations, which grows with the number of iterations unless error feedback compensates.
+template <typename T, typename Comm>
+void accuracy(T *sendbuf_d, T *recvbuf_d, size_t count, int numiter, Comm &comm) {
+
+  std::vector<T> sendbuf(count);
+  std::vector<T> recvbuf(count);
+  std::vector<double> exact(count);
+  std::vector<double> sum_exact(count, 0);
+  std::vector<double> sum_result(count, 0);
+  srand(myid + 1);
+
+  if(myid == printid)
+    printf("accuracy of %d iterations with %zu elements:\n", numiter, count);
+  for(int iter = 0; iter < numiter; iter++) {
+    for(size_t i = 0; i < count; i++)
+      sendbuf[i] = (T) (rand() / (double) RAND_MAX - 0.5);
+    CommBench::memcpyH2D(sendbuf_d, sendbuf.data(), count);
+#ifdef PORT_CUDA
+    cudaDeviceSynchronize();
+#elif defined PORT_HIP
+    hipDeviceSynchronize();
+#endif
+    MPI_Barrier(comm_mpi);
+    double time = MPI_Wtime();
+    comm.run();
+    time = MPI_Wtime() - time;
+    MPI_Allreduce(MPI_IN_PLACE, &time, 1, MPI_DOUBLE, MPI_MAX, comm_mpi);
+    CommBench::memcpyD2H(recvbuf.data(), recvbuf_d, count);
+
+    for(size_t i = 0; i < count; i++)
+      exact[i] = sendbuf[i];
+    MPI_Allreduce(MPI_IN_PLACE, exact.data(), count, MPI_DOUBLE, MPI_SUM, comm_mpi);
+    // ERROR (MAX, SQUARED) AND MAGNITUDE (SQUARED) OF THIS CALL AND OF THE ACCUMULATED SUM
+    double error[5] = {0, 0, 0, 0, 0};
+    for(size_t i = 0; i < count; i++) {
+      double diff = recvbuf[i] - exact[i];
+      sum_exact[i] += exact[i];
+      sum_result[i] += recvbuf[i];
+      double sum_diff = sum_result[i] - sum_exact[i];
+      error[0] = std::max(error[0], std::fabs(diff));
+      error[1] += diff * diff;
+      error[2] += exact[i] * exact[i];
+      error[3] += sum_diff * sum_diff;
+      error[4] += sum_exact[i] * sum_exact[i];
+    }
+    MPI_Allreduce(MPI_IN_PLACE, error, 1, MPI_DOUBLE, MPI_MAX, comm_mpi);
+    MPI_Allreduce(MPI_IN_PLACE, error + 1, 4, MPI_DOUBLE, MPI_SUM, comm_mpi);
+    if(myid == printid)
+      printf("iter %d time %.4e s bandwidth %.4e GB/s max error %.4e relative rms error %.4e accumulated %.4e\n", iter, time, count * sizeof(T) / time / 1e9, error[0], std::sqrt(error[1] / error[2]), std::sqrt(error[3] / error[4]));
+  }
+  if(myid == printid)
+    printf("\n");
+}
+
+// THROUGHPUT COST OF BITWISE-REPRODUCIBLE REDUCTIONS: setup ADDS THE PRIMITIVES AND PARAMETERS OF A PLAN, WHICH IS INITIALIZED AND
+// MEASURED TWICE, BY DEFAULT AND WITH set_reproducible(true), e.g., measure_reproducible<float>(5, 10, count, [&] (Comm<float> &comm) { ... });
+template <typename T, typename A = typename accumulator<T>::type, typename Setup>
+void measure_reproducible(int warmup, int numiter, size_t count, Setup setup) {
+  double medTime[2];
+  for(int reproducible = 0; reproducible < 2; reproducible++) {
+    Comm<T, A> comm;
+    setup(comm);
+    comm.set_reproducible(reproducible);
+    comm.init();
+    std::vector<double> times(numiter);
+    for(int iter = -warmup; iter < numiter; iter++) {
+#ifdef PORT_CUDA
+      cudaDeviceSynchronize();
+#elif defined PORT_HIP
+      hipDeviceSynchronize();
+#endif
+      MPI_Barrier(comm_mpi);
+      double time = MPI_Wtime();
+      comm.run();
+      time = MPI_Wtime() - time;
+      MPI_Allreduce(MPI_IN_PLACE, &time, 1, MPI_DOUBLE, MPI_MAX, comm_mpi);
+      if(iter > -1)
+        times[iter] = time;
+    }
+    std::sort(times.begin(), times.end());
+    medTime[reproducible] = times[numiter / 2];
+  }
+  if(myid == printid) {
+    double data = count * sizeof(T);
+    printf("default reductions medTime: %.4e us, %.4e GB/s\n", medTime[0] * 1e6, data / medTime[0] / 1e9);
+    printf("reproducible reductions medTime: %.4e us, %.4e GB/s\n", medTime[1] * 1e6, data / medTime[1] / 1e9);
+    printf("cost of reproducibility: %.2fx\n", medTime[1] / medTime[0]);
+    printf("\n");
+  }
+}
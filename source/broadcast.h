@@ -7,7 +7,7 @@
     size_t recvoffset;
     size_t count;
     int sendid;
-    std::vector<int> recvids;
+    Ranks recvids;
 
     void report() {
       if(printid < 0)
@@ -49,25 +49,22 @@
       }
     }
 
-    BROADCAST(T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count, int sendid, std::vector<int> &recvids) : sendbuf(sendbuf), sendoffset(sendoffset), recvbuf(recvbuf), recvoffset(recvoffset), count(count), sendid(sendid), recvids(recvids) { }
+    BROADCAST(T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count, int sendid, Ranks recvids) : sendbuf(sendbuf), sendoffset(sendoffset), recvbuf(recvbuf), recvoffset(recvoffset), count(count), sendid(sendid), recvids(std::move(recvids)) { }
 
     BROADCAST(T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count, int sendid, int recvid) : sendbuf(sendbuf), sendoffset(sendoffset), recvbuf(recvbuf), recvoffset(recvoffset), count(count), sendid(sendid) {
-      for(int i = 0; i < numproc; i++) {
-        if(recvid == numproc)
-          recvids.push_back(i);
-        else if(recvid == -1) {
-          if(i != sendid)
-            recvids.push_back(i);
-        }
-        else
-          if(i == recvid)
-            recvids.push_back(i);
+      if(recvid == numproc)
+        recvids.push_back(0, numproc);
+      else if(recvid == -1) {
+        recvids.push_back(0, sendid);
+        recvids.push_back(sendid + 1, numproc);
       }
+      else if(recvid > -1 && recvid < numproc)
+        recvids.push_back(recvid);
     }
   };
 
   template <typename T>
-  void bcast_tree(int numlevel, int groupsize[], CommBench::library lib[], std::vector<BROADCAST<T>> bcastlist, int level, std::list<Coll<T>*> &coll_list) {
+  void bcast_tree(int numlevel, int groupsize[], CommBench::library lib[], std::vector<BROADCAST<T>> bcastlist, int level, std::list<Coll<T>*> &coll_list, bool local) {
 
     if(numproc != groupsize[0]) {
       printf("ERROR!!! groupsize[0] must be equal to numproc.\n");
@@ -78,7 +75,7 @@
     if(bcastlist.size() == 0)
       return;
 
-    Coll<T> *coll_temp = new Coll<T>(lib[level-1]);
+    Coll<T> *coll_temp = new Coll<T>(lib[level-1], level-1, local);
 
     std::vector<BROADCAST<T>> bcastlist_new;
 
@@ -86,8 +83,8 @@
     if(level == numlevel) {
       // if(printid == printid)
       //   printf("************************************ leaf level %d groupsize %d\n", level, groupsize[level - 1]);
-      for(auto bcast : bcastlist)
-        for(auto recvid : bcast.recvids) {
+      for(auto &bcast : bcastlist)
+        for(auto &recvid : bcast.recvids) {
           coll_temp->add(bcast.sendbuf, bcast.sendoffset, bcast.recvbuf, bcast.recvoffset, bcast.count, bcast.sendid, recvid);
         }
       // if(printid == printid)
@@ -97,113 +94,80 @@
       int numgroup = numproc / groupsize[level];
       // LOCAL COMMUNICATIONS
       {
-        for(auto bcast : bcastlist) {
+        for(auto &bcast : bcastlist) {
           int sendgroup = bcast.sendid / groupsize[level];
-          for(int recvgroup = 0; recvgroup < numgroup; recvgroup++) {
-            if(sendgroup == recvgroup) {
-              std::vector<int> recvids;
-              for(auto recvid : bcast.recvids) {
-                int group = recvid / groupsize[level];
-                if(group == recvgroup)
-                  recvids.push_back(recvid);
-              }
-              if(recvids.size())
-                bcastlist_new.push_back(BROADCAST<T>(bcast.sendbuf, bcast.sendoffset, bcast.recvbuf, bcast.recvoffset, bcast.count, bcast.sendid, recvids));
-            }
-          }
+          Ranks recvids = bcast.recvids.select(sendgroup * groupsize[level], (sendgroup + 1) * groupsize[level]);
+          if(recvids.size())
+            bcastlist_new.push_back(BROADCAST<T>(bcast.sendbuf, bcast.sendoffset, bcast.recvbuf, bcast.recvoffset, bcast.count, bcast.sendid, std::move(recvids)));
         }
       }
       // GLOBAL COMMUNICATIONS
       {
+        // PRIMITIVES BY RECEIVING GROUP (INSTEAD OF SCANNING ALL PRIMITIVES FOR EACH GROUP)
+        std::vector<std::vector<int>> recvgroup_bcast(numgroup);
+        std::vector<int> group;
+        for(int i = 0; i < bcastlist.size(); i++) {
+          bcastlist[i].recvids.groups(groupsize[level], group);
+          for(auto &recvgroup : group)
+            if(recvgroup != bcastlist[i].sendid / groupsize[level])
+              recvgroup_bcast[recvgroup].push_back(i);
+        }
         for(int recvgroup = 0; recvgroup < numgroup; recvgroup++) {
-          for(auto bcast : bcastlist) {
-            int sendgroup = bcast.sendid / groupsize[level];
-            if(sendgroup != recvgroup) {
-              std::vector<int> recvids;
-              for(auto recvid : bcast.recvids) {
-                if(recvid / groupsize[level] == recvgroup)
-                  recvids.push_back(recvid);
-              }
-              if(recvids.size()) {
-                int recvid = recvgroup * groupsize[level] + bcast.sendid % groupsize[level];
-                // if(printid == printid)
-                //  printf("level %d groupsize %d numgroup %d sendgroup %d recvgroup %d recvid %d\n", level, groupsize[level], numgroup, sendgroup, recvgroup, recvid);
-                T *recvbuf;
-                size_t recvoffset;
-                bool found = false;
-                for(auto it = recvids.begin(); it != recvids.end(); ++it) {
-                  if(*it == recvid) {
-                    //if(printid == printid)
-                    //  printf("******************************************************************************************* found recvid %d\n", *it);
-                    recvbuf = bcast.recvbuf;
-                    recvoffset = bcast.recvoffset;
-                    found = true;
-                    recvids.erase(it);
-                    break;
-                  }
-                }
-                if(found) {
-                  if(myid == recvid)
-                    reuse += bcast.count;
-                }
-                else {
-                  if(myid == recvid) {
-                    CommBench::allocate(recvbuf, bcast.count);
-                    recvoffset = 0;
-                    buffsize += bcast.count;
-                  }
-                  //if(printid == printid)
-                  //  printf("^^^^^^^^^^^^^^^^^^^^^^^ recvid %d myid %d allocates\n", recvid, myid);
-                }
-                coll_temp->add(bcast.sendbuf, bcast.sendoffset, recvbuf,  recvoffset, bcast.count, bcast.sendid, recvid);
-                if(recvids.size())
-                  bcastlist_new.push_back(BROADCAST<T>(recvbuf, recvoffset, bcast.recvbuf, bcast.recvoffset, bcast.count, recvid, recvids));
+          for(auto &i : recvgroup_bcast[recvgroup]) {
+            BROADCAST<T> &bcast = bcastlist[i];
+            Ranks recvids = bcast.recvids.select(recvgroup * groupsize[level], (recvgroup + 1) * groupsize[level]);
+            int recvid = select_rank(recvgroup * groupsize[level] + bcast.sendid % groupsize[level], recvids);
+            // if(printid == printid)
+            //  printf("level %d groupsize %d numgroup %d recvgroup %d recvid %d\n", level, groupsize[level], numgroup, recvgroup, recvid);
+            T *recvbuf;
+            size_t recvoffset;
+            if(recvids.erase(recvid)) {
+              recvbuf = bcast.recvbuf;
+              recvoffset = bcast.recvoffset;
+              if(myid == recvid)
+                reuse += bcast.count;
+            }
+            else {
+              if(myid == recvid) {
+                allocate_buffer(recvbuf, bcast.count);
+                recvoffset = 0;
               }
             }
+            coll_temp->add(bcast.sendbuf, bcast.sendoffset, recvbuf,  recvoffset, bcast.count, bcast.sendid, recvid);
+            if(recvids.size())
+              bcastlist_new.push_back(BROADCAST<T>(recvbuf, recvoffset, bcast.recvbuf, bcast.recvoffset, bcast.count, recvid, std::move(recvids)));
           }
         }
       }
     }
-    if(coll_temp->numcomm)
+    if(coll_temp->numcomm_all)
       coll_list.push_back(coll_temp);
     else
       delete coll_temp;
-    bcast_tree(numlevel, groupsize, lib, bcastlist_new, level + 1, coll_list);
+    bcast_tree(numlevel, groupsize, lib, std::move(bcastlist_new), level + 1, coll_list, local);
   }
 
   template<typename T>
-  void bcast_ring(int groupsize, CommBench::library lib, std::vector<BROADCAST<T>> &bcastlist, std::vector<BROADCAST<T>> &bcastlist_intra, std::list<Coll<T>*> &coll_list) {
+  void bcast_ring(int groupsize, CommBench::library lib, std::vector<BROADCAST<T>> &bcastlist, std::vector<BROADCAST<T>> &bcastlist_intra, std::list<Coll<T>*> &coll_list, bool local) {
 
     std::vector<BROADCAST<T>> bcastlist_extra;
 
-    Coll<T> *coll_temp = new Coll<T>(lib);
+    Coll<T> *coll_temp = new Coll<T>(lib, 0, local);
 
     for(auto &bcast : bcastlist) {
       int sendnode = bcast.sendid / groupsize;
-      std::vector<int> recvids_intra;
-      std::vector<int> recvids_extra;
-      for(auto &recvid : bcast.recvids) {
-        int recvnode = recvid / groupsize;
-        if(sendnode == recvnode)
-          recvids_intra.push_back(recvid);
-        else
-          recvids_extra.push_back(recvid);
-      }
+      Ranks recvids_intra = bcast.recvids.select(sendnode * groupsize, (sendnode + 1) * groupsize);
+      Ranks recvids_extra = bcast.recvids.exclude(sendnode * groupsize, (sendnode + 1) * groupsize);
       // if(printid == printid)
       //   printf("recvids_intra: %zu recvids_extra: %zu\n", recvids_intra.size(), recvids_extra.size());
       if(recvids_intra.size())
-        bcastlist_intra.push_back(BROADCAST<T>(bcast.sendbuf, bcast.sendoffset, bcast.recvbuf, bcast.recvoffset, bcast.count, bcast.sendid, recvids_intra));
+        bcastlist_intra.push_back(BROADCAST<T>(bcast.sendbuf, bcast.sendoffset, bcast.recvbuf, bcast.recvoffset, bcast.count, bcast.sendid, std::move(recvids_intra)));
       if(recvids_extra.size()) {
         T *recvbuf;
         size_t recvoffset;
-        int recvid = ((sendnode + 1) % (numproc / groupsize)) * groupsize + bcast.sendid % groupsize;
-        bool found = false;
-        for(auto it = recvids_extra.begin(); it != recvids_extra.end(); it++)
-          if(*it == recvid) {
-            found = true;
-            recvids_extra.erase(it);
-            break;
-          }
+        int recvnode = (sendnode + 1) % (numproc / groupsize);
+        int recvid = select_rank(recvnode * groupsize + bcast.sendid % groupsize, recvids_extra.select(recvnode * groupsize, (recvnode + 1) * groupsize));
+        bool found = recvids_extra.erase(recvid);
 	if(myid == recvid) {
           if(found) {
             recvbuf = bcast.recvbuf;
@@ -211,23 +175,22 @@
             reuse += bcast.count;
           }
           else {
-            CommBench::allocate(recvbuf, bcast.count);
+            allocate_buffer(recvbuf, bcast.count);
             recvoffset = 0;
-            buffsize += bcast.count;
           }
         }
         coll_temp->add(bcast.sendbuf, bcast.sendoffset, recvbuf, recvoffset, bcast.count, bcast.sendid, recvid);
         if(recvids_extra.size())
-          bcastlist_extra.push_back(BROADCAST<T>(recvbuf, recvoffset, bcast.recvbuf, bcast.recvoffset, bcast.count, recvid, recvids_extra));
+          bcastlist_extra.push_back(BROADCAST<T>(recvbuf, recvoffset, bcast.recvbuf, bcast.recvoffset, bcast.count, recvid, std::move(recvids_extra)));
       }
     }
-    if(coll_temp->numcomm)
+    if(coll_temp->numcomm_all)
       coll_list.push_back(coll_temp);
     else
       delete coll_temp;
 
     if(bcastlist_extra.size()) // IMPLEMENT RING FOR EXTRA-NODE COMMUNICATIONS (IF THERE IS STILL LEFT)
-      bcast_ring(groupsize, lib, bcastlist_extra, bcastlist_intra, coll_list);
+      bcast_ring(groupsize, lib, bcastlist_extra, bcastlist_intra, coll_list, local);
     /*else { // ELSE IMPLEMENT TREE FOR INTRA-NODE COMMUNICATION
       std::vector<int> groupsize_temp(groupsize, groupsize + numlevel);
       groupsize_temp[0] = numproc;
@@ -235,8 +198,11 @@
     }*/
   }
 
+  // STRIPE THE PRIMITIVES THAT STAY WITHIN A GROUP OF groupsize PROCESSES (numproc AT LEVEL 0) BUT LEAVE THE GROUP OF nextsize PROCESSES OF THE SENDER
+  // (THE GROUP OF THE NEXT LEVEL, OR THE NODE OF numstripe PROCESSES AT LEVEL 0) OVER THE numstripe PROCESSES OF THE SENDER
+  // THE PIECES GO TO stripe_list (SO THAT A LOWER LEVEL DOES NOT STRIPE THEM AGAIN), THE REST (AND ALL FOR A SINGLE STRIPE) STAYS IN bcastlist
   template <typename T, typename P>
-  void stripe(int numstripe, std::vector<BROADCAST<T>> &bcastlist, std::vector<P> &split_list) {
+  void stripe(int numstripe, int groupsize, int nextsize, std::vector<BROADCAST<T>> &bcastlist, std::vector<BROADCAST<T>> &stripe_list, std::vector<P> &split_list, const Options &options) {
 
     int nodesize = numstripe;
 
@@ -244,48 +210,35 @@
     std::vector<BROADCAST<T>> bcastlist_intra;
     std::vector<BROADCAST<T>> bcastlist_inter;
     for(auto &bcast : bcastlist) {
-      int sendid = bcast.sendid;
-      std::vector<int> recvid_intra;
-      std::vector<int> recvid_inter;
-      for(auto &recvid : bcast.recvids)
-        if(sendid / nodesize == recvid / nodesize)
-          recvid_intra.push_back(recvid);
-        else
-          recvid_inter.push_back(recvid);
-      if(recvid_inter.size())
-        bcastlist_inter.push_back(BROADCAST<T>(bcast.sendbuf, bcast.sendoffset, bcast.recvbuf, bcast.recvoffset, bcast.count, bcast.sendid, bcast.recvids));
+      int sendnext = bcast.sendid / nextsize;
+      int sendgroup = bcast.sendid / groupsize;
+      bool inter = bcast.recvids.count(sendnext * nextsize, (sendnext + 1) * nextsize) < bcast.recvids.size();
+      bool inside = bcast.recvids.count(sendgroup * groupsize, (sendgroup + 1) * groupsize) == bcast.recvids.size();
+      if(inter && inside)
+        bcastlist_inter.push_back(std::move(bcast));
       else
-        bcastlist_intra.push_back(BROADCAST<T>(bcast.sendbuf, bcast.sendoffset, bcast.recvbuf, bcast.recvoffset, bcast.count, bcast.sendid, bcast.recvids));
+        bcastlist_intra.push_back(std::move(bcast));
     }
-    // CLEAR BROADCASTLIST
-    bcastlist.clear();
     // ADD INTRA-NODE BROADCAST DIRECTLY (IF ANY)
-    for(auto &bcast : bcastlist_intra)
-      bcastlist.push_back(BROADCAST<T>(bcast.sendbuf, bcast.sendoffset, bcast.recvbuf, bcast.recvoffset, bcast.count, bcast.sendid, bcast.recvids));
+    bcastlist = std::move(bcastlist_intra);
 
     // ADD INTER-NODE BROADCAST BY STRIPING
     if(bcastlist_inter.size()) {
       for(auto &bcast : bcastlist_inter) {
         int sendgroup = bcast.sendid / nodesize;
+        std::vector<size_t> split;
+        stripe_split(bcast.count, numstripe, sendgroup, split, options.stripe_weight);
         size_t splitoffset = 0;
         for(int stripe = 0; stripe < numstripe; stripe++) {
           int sender = sendgroup * nodesize + stripe;
-          size_t splitcount = bcast.count / numstripe + (stripe < bcast.count % numstripe ? 1 : 0);
-          if(splitcount) {
+          size_t splitcount = split[stripe];
+          if(splitcount || options.parametric) {
             T *sendbuf;
             size_t sendoffset;
-            std::vector<int> recvids = bcast.recvids;
+            Ranks recvids = bcast.recvids;
             if(sender != bcast.sendid) {
-              bool found = false;
               // REUSE
-              for(auto it = recvids.begin(); it < recvids.end(); it++) {
-                if(*it == sender) {
-                  recvids.erase(it);
-                  found = true;
-                  break;
-                }
-              }
-              if(found) {
+              if(recvids.erase(sender)) {
                 if(myid == sender) {
                   sendbuf = bcast.recvbuf;
                   sendoffset = bcast.recvoffset + splitoffset;
@@ -294,9 +247,8 @@
               }
               else {
                 if(myid == sender) {
-                  CommBench::allocate(sendbuf, splitcount);
+                  allocate_buffer(sendbuf, splitcount);
                   sendoffset = 0;
-                  buffsize += splitcount;
                 }
               }
               split_list.push_back(P(bcast.sendbuf, bcast.sendoffset + splitoffset, sendbuf, sendoffset, splitcount, bcast.sendid, sender));
@@ -308,23 +260,24 @@
                 reuse += splitcount;
               }
             }
-            bcastlist.push_back(BROADCAST<T>(sendbuf, sendoffset, bcast.recvbuf, bcast.recvoffset + splitoffset, splitcount, sender, recvids));
+            (numstripe > 1 ? stripe_list : bcastlist).push_back(BROADCAST<T>(sendbuf, sendoffset, bcast.recvbuf, bcast.recvoffset + splitoffset, splitcount, sender, std::move(recvids)));
             splitoffset += splitcount;
           }
-          else
-            break;
         }
       }
     }
   }
 
+  // SPLIT EACH PRIMITIVE INTO numbatch EQUAL PIECES, OR INTO PIECES OF chunk ELEMENTS IF GIVEN (TRAILING BATCHES MAY BE EMPTY)
   template <typename T>
-  void partition(std::vector<BROADCAST<T>> &bcastlist, int numbatch, std::vector<std::vector<BROADCAST<T>>> &bcast_batch) {
+  void partition(std::vector<BROADCAST<T>> &bcastlist, int numbatch, std::vector<std::vector<BROADCAST<T>>> &bcast_batch, size_t chunk = 0, bool parametric = false) {
     for(auto &bcast : bcastlist) {
       size_t batchoffset = 0;
       for(int batch = 0; batch < numbatch; batch++) {
         size_t batchsize = bcast.count / numbatch + (batch < bcast.count % numbatch ? 1 : 0);
-        if(batchsize) {
+        if(chunk)
+          batchsize = std::min(chunk, bcast.count - batchoffset);
+        if(batchsize || parametric) {
           bcast_batch[batch].push_back(BROADCAST<T>(bcast.sendbuf, bcast.sendoffset + batchoffset, bcast.recvbuf, bcast.recvoffset + batchoffset, batchsize, bcast.sendid, bcast.recvids));
           batchoffset += batchsize;
         }
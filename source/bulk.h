@@ -0,0 +1,333 @@
+
+  // BULK PRIMITIVES: A REGULAR PATTERN OF ALL PROCESSES AS ONE OBJECT
+  // alltoall: process s sends its block r (sendoffset + r * stride) to process r (recvoffset + s * stride)
+  // allgather: process s sends its block (sendoffset) to all processes (recvoffset + s * stride)
+  // gather: process s sends its block (sendoffset) to root (recvoffset + s * stride)
+  // The planner routes them by the digits of the ranks in the hierarchy instead of carrying numproc (or numproc^2) primitives,
+  // the messages of a level carry the blocks of a whole subgroup, and transfers are expanded only when the steps are emitted
+  // (when materialized locally, only those of this process). Striping and ring do not apply to bulk primitives.
+  template <typename T>
+  struct BULK {
+    int type; // alltoall or allgather
+    T* sendbuf;
+    size_t sendoffset;
+    T* recvbuf;
+    size_t recvoffset;
+    size_t count; // per block
+    size_t stride; // between blocks (count, or larger within a pipeline batch)
+    int root; // of gather
+
+    void report() {
+      if(myid == printid) {
+        printf("%s report: count %lu (", type == alltoall ? "ALL-TO-ALL" : (type == allgather ? "ALL-GATHER" : "GATHER"), count);
+        CommBench::print_data(count * sizeof(T));
+        printf(") per block, stride %lu sendoffset %lu recvoffset %lu", stride, sendoffset, recvoffset);
+        if(type == gather)
+          printf(" root %d", root);
+        printf("\n\n");
+      }
+    }
+
+    BULK(int type, T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count, size_t stride, int root = -1) : type(type), sendbuf(sendbuf), sendoffset(sendoffset), recvbuf(recvbuf), recvoffset(recvoffset), count(count), stride(stride), root(root) {}
+  };
+
+  // DIGIT OF rank AT level (POSITION OF ITS SUBGROUP WITHIN ITS GROUP), groupsize[numlevel] IS 1
+  inline int digit(int rank, int groupsize[], int level) {
+    return (rank % groupsize[level]) / groupsize[level + 1];
+  }
+
+  // PROCESSES THAT SEND AT level: ALL, OR (LOCAL) THIS ONE AND ITS PEERS IN THE OTHER SUBGROUPS OF ITS GROUP
+  inline std::vector<int> bulk_senders(int groupsize[], int level, bool local) {
+    std::vector<int> sender;
+    if(local)
+      for(int k = 0; k < groupsize[level] / groupsize[level + 1]; k++)
+        sender.push_back(myid + (k - digit(myid, groupsize, level)) * groupsize[level + 1]);
+    else
+      for(int p = 0; p < numproc; p++)
+        sender.push_back(p);
+    return sender;
+  }
+
+  // PROCESSES OF THE GROUP OF myid AT level WHEN LOCAL (ALL OTHERWISE)
+  inline std::vector<int> bulk_group(int groupsize[], int level, bool local) {
+    std::vector<int> member;
+    int first = (local ? myid / groupsize[level] * groupsize[level] : 0);
+    for(int p = first; p < (local ? first + groupsize[level] : numproc); p++)
+      member.push_back(p);
+    return member;
+  }
+
+  // ALL-TO-ALL, TOP-DOWN: AT EACH level, A PROCESS SENDS THE BLOCKS IT HOLDS FOR THE PROCESSES OF ANOTHER SUBGROUP TO ITS PEER
+  // THERE (SAME DIGITS BELOW level) IN ONE MESSAGE. The block of s for r is held by the process with the digits of r above
+  // level and of s below. A process receives the messages of level l < numlevel - 1 into a buffer of numproc blocks, the slot
+  // of origin s is s / groupsize[l + 1], and the last level delivers into recvbuf.
+  // AGGREGATED levels send one message per pair of subgroups instead of one per pair of peers: the members pack their blocks
+  // for subgroup k at a proxy (member k % size), which sends them to the proxy of the receiving subgroup, which unpacks them to
+  // the peers. The proxies of the pairs are spread over the members, so that each process keeps about numproc blocks.
+  template <typename T>
+  void bulk_alltoall(int numlevel, int groupsize_in[], CommBench::library lib[], BULK<T> &bulk, std::list<Coll<T>*> &coll_list, const std::vector<bool> &aggregate, bool local) {
+
+    std::vector<int> groupsize(groupsize_in, groupsize_in + numlevel);
+    groupsize.push_back(1);
+    if(groupsize[0] != numproc || numproc % groupsize[1]) {
+      printf("ERROR!!! bulk primitives need groupsize[0] = numproc and a divisor groupsize[1].\n");
+      return;
+    }
+    size_t count = bulk.count;
+    std::vector<T*> buffer(numlevel, nullptr); // of this process, per level
+    for(int level = 0; level < numlevel - 1; level++)
+      if(groupsize[level] > groupsize[level + 1])
+        allocate_buffer(buffer[level], numproc * count);
+
+    // BLOCK OF ORIGIN s HELD BY h AT level FOR THE FIRST PROCESS OF ITS GROUP AT level (THE OTHERS FOLLOW stride APART)
+    auto held = [&] (int h, int s, int level, T *&buf, size_t &offset, size_t &stride) {
+      int first = h / groupsize[level] * groupsize[level];
+      int last = -1; // last level where the block moved
+      for(int l = 0; l < level; l++)
+        if(digit(s, groupsize.data(), l) != digit(h, groupsize.data(), l))
+          last = l;
+      if(last == -1) {
+        buf = bulk.sendbuf;
+        offset = bulk.sendoffset + first * bulk.stride;
+        stride = bulk.stride;
+      }
+      else {
+        int slotfirst = h / groupsize[last + 1] * groupsize[last + 1];
+        buf = buffer[last];
+        offset = (s / groupsize[last + 1] * groupsize[last + 1] + first - slotfirst) * count;
+        stride = count;
+      }
+    };
+
+    for(int level = 0; level < numlevel; level++) {
+      int numsub = groupsize[level] / groupsize[level + 1];
+      bool leaf = (level == numlevel - 1);
+      if(numsub == 1 && !leaf)
+        continue;
+      int size = groupsize[level + 1];
+      if(!leaf && size > 1 && level < aggregate.size() && aggregate[level]) {
+        int numorigin = numproc / groupsize[level]; // of the blocks held by each process
+        size_t slot = (size_t) size * numorigin * size * count; // blocks of a pair of subgroups
+        int numslot = (numsub + size - 1) / size; // pairs per proxy
+        T *pack = nullptr;
+        T *unpack = nullptr;
+        if(myid % size < numsub) {
+          allocate_buffer(pack, numslot * slot);
+          allocate_buffer(unpack, numslot * slot);
+        }
+        Coll<T> *coll_pack = new Coll<T>(lib[level + 1], level + 1, local);
+        Coll<T> *coll = new Coll<T>(lib[level], level, local);
+        Coll<T> *coll_unpack = new Coll<T>(lib[level + 1], level + 1, local);
+        auto involved = [&] (int sendid, int recvid) {
+          return !local || sendid == myid || recvid == myid;
+        };
+        for(auto &h : bulk_group(groupsize.data(), level, local)) {
+          int first = h / groupsize[level] * groupsize[level];
+          int j = digit(h, groupsize.data(), level);
+          int m = h % size;
+          for(int k = 0; k < numsub; k++) {
+            if(k == j)
+              continue; // stays with h
+            int sendproxy = first + j * size + k % size;
+            int recvproxy = first + k * size + j % size;
+            int recvid = first + k * size + m; // peer of h
+            for(int a = 0; a < numorigin; a++) {
+              int s = a * groupsize[level] + h % groupsize[level];
+              T *sendbuf;
+              size_t sendoffset;
+              size_t stride;
+              held(h, s, level, sendbuf, sendoffset, stride);
+              size_t offset = sendoffset + (k * size) * stride;
+              size_t packoffset = (k / size) * slot + ((size_t) m * numorigin + a) * size * count;
+              size_t unpackoffset = (j / size) * slot + ((size_t) m * numorigin + a) * size * count;
+              if(involved(h, sendproxy)) {
+                if(stride == count)
+                  coll_pack->add(sendbuf, offset, pack, packoffset, size * count, h, sendproxy);
+                else
+                  for(int r = 0; r < size; r++)
+                    coll_pack->add(sendbuf, offset + r * stride, pack, packoffset + r * count, count, h, sendproxy);
+              }
+              if(involved(recvproxy, recvid))
+                coll_unpack->add(unpack, unpackoffset, buffer[level], s / size * size * count, size * count, recvproxy, recvid);
+            }
+            if(h == sendproxy && involved(sendproxy, recvproxy))
+              coll->add(pack, (k / size) * slot, unpack, (j / size) * slot, slot, sendproxy, recvproxy);
+          }
+        }
+        coll_list.push_back(coll_pack);
+        coll_list.push_back(coll);
+        coll_list.push_back(coll_unpack);
+        continue;
+      }
+      Coll<T> *coll = new Coll<T>(lib[level], level, local);
+      for(auto &h : bulk_senders(groupsize.data(), level, local)) {
+        // ORIGINS OF THE BLOCKS HELD BY h: THE DIGITS OF h FROM level ON
+        for(int a = 0; a < numproc / groupsize[level]; a++) {
+          int s = a * groupsize[level] + h % groupsize[level];
+          T *sendbuf;
+          size_t sendoffset;
+          size_t stride;
+          held(h, s, level, sendbuf, sendoffset, stride);
+          for(int k = 0; k < numsub; k++) {
+            int recvid = h + (k - digit(h, groupsize.data(), level)) * size;
+            if(recvid == h && !leaf)
+              continue; // stays with h
+            if(local && h != myid && recvid != myid)
+              continue;
+            size_t offset = sendoffset + (k * size) * stride;
+            if(leaf)
+              coll->add(sendbuf, offset, bulk.recvbuf, bulk.recvoffset + s * bulk.stride, count, h, recvid);
+            else {
+              size_t recvoffset = s / size * size * count;
+              if(stride == count)
+                coll->add(sendbuf, offset, buffer[level], recvoffset, size * count, h, recvid);
+              else
+                for(int r = 0; r < size; r++)
+                  coll->add(sendbuf, offset + r * stride, buffer[level], recvoffset + r * count, count, h, recvid);
+            }
+          }
+        }
+      }
+      coll_list.push_back(coll);
+    }
+  }
+
+  // ALL-GATHER, BOTTOM-UP: AT EACH level, A PROCESS SENDS THE BLOCKS OF ITS SUBGROUP (GATHERED BELOW) TO ITS PEERS IN THE OTHER
+  // SUBGROUPS OF ITS GROUP IN ONE MESSAGE, STARTING FROM ITS OWN BLOCK AT THE LEAF LEVEL
+  template <typename T>
+  void bulk_allgather(int numlevel, int groupsize_in[], CommBench::library lib[], BULK<T> &bulk, std::list<Coll<T>*> &coll_list, bool local) {
+
+    std::vector<int> groupsize(groupsize_in, groupsize_in + numlevel);
+    groupsize.push_back(1);
+    if(groupsize[0] != numproc || numproc % groupsize[1]) {
+      printf("ERROR!!! bulk primitives need groupsize[0] = numproc and a divisor groupsize[1].\n");
+      return;
+    }
+    size_t count = bulk.count;
+    for(int level = numlevel - 1; level > -1; level--) {
+      int numsub = groupsize[level] / groupsize[level + 1];
+      bool leaf = (level == numlevel - 1);
+      if(numsub == 1 && !leaf)
+        continue;
+      Coll<T> *coll = new Coll<T>(lib[level], level, local);
+      int size = groupsize[level + 1];
+      for(auto &h : bulk_senders(groupsize.data(), level, local)) {
+        int first = h / size * size; // of the blocks h has
+        for(int k = 0; k < numsub; k++) {
+          int recvid = h + (k - digit(h, groupsize.data(), level)) * size;
+          if(recvid == h && !leaf)
+            continue;
+          if(local && h != myid && recvid != myid)
+            continue;
+          size_t offset = bulk.recvoffset + first * bulk.stride;
+          if(leaf)
+            coll->add(bulk.sendbuf, bulk.sendoffset, bulk.recvbuf, offset, count, h, recvid);
+          else if(bulk.stride == count)
+            coll->add(bulk.recvbuf, offset, bulk.recvbuf, offset, size * count, h, recvid);
+          else
+            for(int r = 0; r < size; r++)
+              coll->add(bulk.recvbuf, offset + r * bulk.stride, bulk.recvbuf, offset + r * bulk.stride, count, h, recvid);
+        }
+      }
+      coll_list.push_back(coll);
+    }
+  }
+
+  // GATHER, BOTTOM-UP: AT EACH level, THE PROCESSES WITH THE DIGITS OF root BELOW level + 1 SEND THE BLOCKS OF THEIR SUBGROUP
+  // (COLLECTED BELOW) IN ONE MESSAGE TO THE PROCESS WITH THE DIGITS OF root BELOW level IN THEIR GROUP, STARTING FROM THE BLOCK
+  // OF EACH PROCESS AT THE LEAF LEVEL. Collectors other than root keep the blocks of their group at the highest level they
+  // collect in a buffer.
+  template <typename T>
+  void bulk_gather(int numlevel, int groupsize_in[], CommBench::library lib[], BULK<T> &bulk, std::list<Coll<T>*> &coll_list, bool local) {
+
+    std::vector<int> groupsize(groupsize_in, groupsize_in + numlevel);
+    groupsize.push_back(1);
+    if(groupsize[0] != numproc || numproc % groupsize[1]) {
+      printf("ERROR!!! bulk primitives need groupsize[0] = numproc and a divisor groupsize[1].\n");
+      return;
+    }
+    if(bulk.root < 0 || bulk.root >= numproc) {
+      printf("ERROR!!! gather root %d is not a process.\n", bulk.root);
+      return;
+    }
+    size_t count = bulk.count;
+    int root = bulk.root;
+    // HIGHEST LEVEL WHERE c COLLECTS (numlevel: NONE)
+    auto top = [&] (int c) {
+      for(int level = 0; level < numlevel; level++)
+        if(c % groupsize[level] == root % groupsize[level])
+          return level;
+      return numlevel;
+    };
+    T *buffer = nullptr; // of this process
+    if(myid != root && top(myid) < numlevel)
+      allocate_buffer(buffer, groupsize[top(myid)] * count);
+    // BLOCK OF q COLLECTED BY c
+    auto collected = [&] (int c, int q, T *&buf, size_t &offset, size_t &stride) {
+      if(c == root) {
+        buf = bulk.recvbuf;
+        offset = bulk.recvoffset + q * bulk.stride;
+        stride = bulk.stride;
+      }
+      else {
+        buf = buffer;
+        offset = (q - c / groupsize[top(c)] * groupsize[top(c)]) * count;
+        stride = count;
+      }
+    };
+
+    for(int level = numlevel - 1; level > -1; level--) {
+      int numsub = groupsize[level] / groupsize[level + 1];
+      bool leaf = (level == numlevel - 1);
+      if(numsub == 1 && !leaf)
+        continue;
+      Coll<T> *coll = new Coll<T>(lib[level], level, local);
+      int size = groupsize[level + 1];
+      for(auto &p : bulk_group(groupsize.data(), level, local)) {
+        if(p % size != root % size)
+          continue; // not the collector of its subgroup
+        int recvid = p / groupsize[level] * groupsize[level] + root % groupsize[level];
+        if(recvid == p && !leaf)
+          continue;
+        if(local && p != myid && recvid != myid)
+          continue;
+        int first = p / size * size; // of the blocks p has
+        T *recvbuf;
+        size_t recvoffset;
+        size_t recvstride;
+        collected(recvid, first, recvbuf, recvoffset, recvstride);
+        if(leaf)
+          coll->add(bulk.sendbuf, bulk.sendoffset, recvbuf, recvoffset, count, p, recvid);
+        else {
+          T *sendbuf;
+          size_t sendoffset;
+          size_t sendstride;
+          collected(p, first, sendbuf, sendoffset, sendstride);
+          if(sendstride == count && recvstride == count)
+            coll->add(sendbuf, sendoffset, recvbuf, recvoffset, size * count, p, recvid);
+          else
+            for(int r = 0; r < size; r++)
+              coll->add(sendbuf, sendoffset + r * sendstride, recvbuf, recvoffset + r * recvstride, count, p, recvid);
+        }
+      }
+      coll_list.push_back(coll);
+    }
+  }
+
+  template <typename T>
+  void partition(std::vector<BULK<T>> &bulklist, int numbatch, std::vector<std::vector<BULK<T>>> &bulk_batch, size_t chunk = 0, bool parametric = false) {
+    for(auto &bulk : bulklist) {
+      size_t batchoffset = 0;
+      for(int batch = 0; batch < numbatch; batch++) {
+        size_t batchsize = bulk.count / numbatch + (batch < bulk.count % numbatch ? 1 : 0);
+        if(chunk)
+          batchsize = std::min(chunk, bulk.count - batchoffset);
+        if(batchsize || parametric) {
+          bulk_batch[batch].push_back(BULK<T>(bulk.type, bulk.sendbuf, bulk.sendoffset + batchoffset, bulk.recvbuf, bulk.recvoffset + batchoffset, batchsize, bulk.stride, bulk.root));
+          batchoffset += batchsize;
+        }
+        else
+          break;
+      }
+    }
+  }
@@ -4,6 +4,15 @@
     public:
 
     CommBench::library lib;
+    int level;
+    bool reduction = false; // transfers carry partial sums
+    bool pipelined = false; // computations read data of earlier steps only and do not wait for transfers of this step
+    // LOCAL MATERIALIZATION: A PROCESS KEEPS THE TRANSFERS IT SENDS OR RECEIVES AND THE COMPUTATIONS IT RUNS, THE PLANNER
+    // DECIDES BY THE COUNTS ON ALL PROCESSES, AND implement BY THE LIBRARIES ON ALL PROCESSES (usage, OR-REDUCED)
+    bool local;
+    int numcomm_all = 0; // transfers added on all processes (before re-chunking)
+    int numcompute_all = 0; // computations added on all processes
+    unsigned usage = 0; // libraries of the transfers (bit per library) and computation (bit numlib) on all processes
 
     // Communication
     int numcomm = 0;
@@ -14,6 +23,7 @@
     std::vector<size_t> count;
     std::vector<int> sendid;
     std::vector<int> recvid;
+    std::vector<int> codec;
 
     // Computation
     int numcompute = 0;
@@ -22,9 +32,22 @@
     std::vector<size_t> numreduce;
     std::vector<int> compid;
 
-    Coll(CommBench::library lib) : lib(lib) {}
+    Coll(CommBench::library lib, int level = -1, bool local = false) : lib(lib), level(level), local(local) {}
 
-    void add(T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count, int sendid, int recvid) {
+    // MESSAGE-SIZE-AWARE LIBRARY SELECTION (BELOW THRESHOLD GOES TO THE SMALL LIBRARY, THE REST TO THE LARGE ONE)
+    CommBench::library select(size_t count, std::vector<size_t> &threshold, std::vector<CommBench::library> &lib_small, std::vector<CommBench::library> &lib_large) {
+      if(level > -1 && level < threshold.size() && threshold[level])
+        return (count * sizeof(T) < threshold[level] ? lib_small[level] : lib_large[level]);
+      return lib;
+    }
+
+    void add(T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count, int sendid, int recvid, int codec = raw) {
+      numcomm_all++;
+      if(rank_load && sendid != recvid)
+        (*rank_load)[recvid] += count * sizeof(T);
+      if(local && myid != sendid && myid != recvid)
+        return;
+      this->codec.push_back(codec);
       this->sendbuf.push_back(sendbuf);
       this->sendoffset.push_back(sendoffset);
       this->recvbuf.push_back(recvbuf);
@@ -35,7 +58,60 @@
       numcomm++;
     }
 
-    void add(std::vector<T*> inputbuf, T* outputbuf, size_t numreduce, int compid) {
+    // SPLIT THE TRANSFERS INTO MESSAGES OF AT MOST chunk ELEMENTS (THE SAME ON ALL PROCESSES, BOUNDARIES ARE chunk APART FROM THE START)
+    void rechunk(size_t chunk) {
+      Coll<T> split(lib, level);
+      split.local = local;
+      for(int i = 0; i < numcomm; i++) {
+        size_t offset = 0;
+        do {
+          size_t size = std::min(chunk, count[i] - offset);
+          split.add(sendbuf[i], sendoffset[i] + offset, recvbuf[i], recvoffset[i] + offset, size, sendid[i], recvid[i], codec[i]);
+          offset += size;
+        } while(offset < count[i]);
+      }
+      numcomm = split.numcomm;
+      sendbuf = split.sendbuf;
+      sendoffset = split.sendoffset;
+      recvbuf = split.recvbuf;
+      recvoffset = split.recvoffset;
+      count = split.count;
+      sendid = split.sendid;
+      recvid = split.recvid;
+      codec = split.codec;
+    }
+
+    // ROUNDS OF AT MOST fanin SENDERS PER RECEIVER (IN ORDER OF THE TRANSFERS, THOSE OF A PAIR AND SELF COPIES IN ONE ROUND), THE
+    // COMPUTATIONS GO TO THE LAST ROUND. RETURNS THIS STEP ALONE IF NO RECEIVER EXCEEDS fanin, AND maxfanin OF THE RECEIVERS
+    std::vector<Coll<T>*> incast(int fanin, int &maxfanin) {
+      std::map<std::pair<int, int>, int> round; // of each pair
+      std::vector<int> numsender(numproc, 0);
+      for(int i = 0; i < numcomm; i++)
+        if(sendid[i] != recvid[i] && round.find(std::make_pair(sendid[i], recvid[i])) == round.end())
+          round[std::make_pair(sendid[i], recvid[i])] = numsender[recvid[i]]++ / fanin;
+      maxfanin = *std::max_element(numsender.begin(), numsender.end());
+      int numround = (maxfanin + fanin - 1) / fanin;
+      if(numround < 2)
+        return std::vector<Coll<T>*>(1, this);
+      std::vector<Coll<T>*> split(numround);
+      for(auto &coll : split) {
+        coll = new Coll<T>(lib, level, local);
+        coll->reduction = reduction;
+        coll->pipelined = pipelined;
+      }
+      for(int i = 0; i < numcomm; i++)
+        split[sendid[i] == recvid[i] ? 0 : round[std::make_pair(sendid[i], recvid[i])]]->add(sendbuf[i], sendoffset[i], recvbuf[i], recvoffset[i], count[i], sendid[i], recvid[i], codec[i]);
+      for(int i = 0; i < numcompute; i++)
+        split.back()->add(inputbuf[i], outputbuf[i], numreduce[i], compid[i]);
+      return split;
+    }
+
+    void add(const std::vector<T*> &inputbuf, T* outputbuf, size_t numreduce, int compid) {
+      numcompute_all++;
+      if(rank_load)
+        (*rank_load)[compid] += numreduce * sizeof(T) * inputbuf.size();
+      if(local && myid != compid)
+        return;
       this->inputbuf.push_back(inputbuf);
       this->outputbuf.push_back(outputbuf);
       this->numreduce.push_back(numreduce);
@@ -43,51 +119,65 @@
       numcompute++;
     }
 
+    // SHARE OF THIS PROCESS IN THE TOTALS OF A REPORT: WHEN local, EACH TRANSFER COUNTS AT ITS SENDER (AND THE TOTALS ARE SUMMED)
+    bool share(int i) const {
+      return !local || sendid[i] == myid;
+    }
+
     void report() {
+      if(printid < 0)
+        return;
+      std::vector<long> matrix(numproc < 64 ? numproc * numproc : 0, 0);
+      std::vector<long> input(numproc < 64 ? numproc : 0, 0);
+      std::vector<long> output(numproc < 64 ? numproc : 0, 0);
+      std::vector<long> total(4, 0); // communication data, computations, input data, output data
+      for(int i = 0; i < this->numcomm; i++)
+        if(share(i)) {
+          total[0] += this->count[i] * sizeof(T);
+          if(matrix.size())
+            matrix[abs(this->recvid[i]) * numproc + abs(this->sendid[i])]++;
+        }
+      for(int i = 0; i < this->numcompute; i++) {
+        total[1]++;
+        total[2] += this->numreduce[i] * sizeof(T) * this->inputbuf[i].size();
+        total[3] += this->numreduce[i] * sizeof(T);
+        if(output.size()) {
+          input[this->compid[i]] += this->inputbuf[i].size();
+          output[this->compid[i]]++;
+        }
+      }
+      // GLOBAL REPORT ON DEMAND
+      if(local)
+        for(auto *value : {&matrix, &input, &output, &total})
+          MPI_Reduce(myid == printid ? MPI_IN_PLACE : value->data(), value->data(), value->size(), MPI_LONG, MPI_SUM, printid, comm_mpi);
       if(myid == printid) {
         CommBench::print_lib(this->lib);
         printf(" communication: ");
         {
-          std::vector<std::vector<int>> matrix(numproc, std::vector<int>(numproc));
-          size_t data = 0;
-          for(int i = 0; i < this->numcomm; i++) {
-            data += this->count[i] * sizeof(T);
-            matrix[abs(this->recvid[i])][abs(this->sendid[i])]++;
-          }
-          CommBench::print_data(data);
+          CommBench::print_data(total[0]);
           printf("\n");
           if(numproc < 64)
             for(int recv = 0; recv < numproc; recv++) {
               for(int send = 0; send < numproc; send++)
-                if(matrix[recv][send])
-                  printf("%d ", matrix[recv][send]);
+                if(matrix[recv * numproc + send])
+                  printf("%ld ", matrix[recv * numproc + send]);
                 else
                   printf(". ");
               printf("\n");
             }
           printf("\n");
         }
-        if(this->numcompute) {
+        if(total[1]) {
           printf("computation: ");
-          std::vector<int> input(numproc, 0);
-          std::vector<int> output(numproc, 0);
-          size_t inputdata = 0;
-          size_t outputdata = 0;
-          for(int i = 0; i < this->numcompute; i++) {
-            inputdata += this->numreduce[i] * sizeof(T) * this->inputbuf[i].size();
-            outputdata += this->numreduce[i] * sizeof(T);
-            input[this->compid[i]] += this->inputbuf[i].size();
-            output[this->compid[i]]++;
-          }
           printf("input ");
-          CommBench::print_data(inputdata);
+          CommBench::print_data(total[2]);
           printf(" output ");
-          CommBench::print_data(outputdata);
+          CommBench::print_data(total[3]);
           printf("\n");
           if(numproc < 64)
             for(int p = 0; p < numproc; p++)
               if(output[p])
-                printf("%d: %d -> %d\n", p, input[p], output[p]);
+                printf("%d: %ld -> %ld\n", p, input[p], output[p]);
           printf("\n");
         }
       }
@@ -97,6 +187,28 @@
   template <typename T>
   void report_pipeline(std::vector<std::list<Coll<T>*>> &coll_batch) {
 
+    if(printid < 0)
+      return;
+    int print_batch_size = (coll_batch.size() > 16 ? 16 : coll_batch.size());
+    // TRANSFERS AND COMPUTATIONS OF THE PRINTED STEPS (SUMMED OVER THE PROCESSES IF ANY IS MATERIALIZED LOCALLY)
+    std::vector<long> numcomm;
+    std::vector<long> numcompute;
+    bool local = false;
+    for(int i = 0; i < print_batch_size; i++)
+      for(auto &coll : coll_batch[i]) {
+        bool share = coll->local || myid == printid;
+        numcomm.push_back(0);
+        for(int j = 0; j < coll->numcomm; j++)
+          if(share && coll->share(j))
+            numcomm.back()++;
+        numcompute.push_back(share ? coll->numcompute : 0);
+        local |= coll->local;
+      }
+    if(local) {
+      MPI_Reduce(myid == printid ? MPI_IN_PLACE : numcomm.data(), numcomm.data(), numcomm.size(), MPI_LONG, MPI_SUM, printid, comm_mpi);
+      MPI_Reduce(myid == printid ? MPI_IN_PLACE : numcompute.data(), numcompute.data(), numcompute.size(), MPI_LONG, MPI_SUM, printid, comm_mpi);
+    }
+
     // REPORT PIPELINE
     if(myid == printid) {
       printf("********************************************\n\n");
@@ -104,11 +216,13 @@
       if(coll_batch.size())
         printf("coll_list size %zu\n", coll_batch[0].size());
       printf("\n");
-      int print_batch_size = (coll_batch.size() > 16 ? 16 : coll_batch.size());
       using Iter = typename std::list<Coll<T>*>::iterator;
       std::vector<Iter> coll_ptr(print_batch_size);
-      for(int i = 0; i < print_batch_size; i++)
+      std::vector<int> index(print_batch_size); // of the first step of each batch in numcomm and numcompute
+      for(int i = 0; i < print_batch_size; i++) {
         coll_ptr[i] = coll_batch[i].begin();
+        index[i] = (i ? index[i - 1] + coll_batch[i - 1].size() : 0);
+      }
       int collindex = 0;
       while(true) {
         bool finished = true;
@@ -121,11 +235,12 @@
         printf("proc %d index %d: |", myid, collindex);
         for(int i = 0; i < print_batch_size; i++)
           if(coll_ptr[i] != coll_batch[i].end()) {
-            if((*coll_ptr[i])->numcomm)
-              printf(" %d ", (*coll_ptr[i])->numcomm);
+            int k = index[i]++;
+            if(numcomm[k])
+              printf(" %ld ", numcomm[k]);
             else
               printf("   ");
-            if((*coll_ptr[i])->numcomm + (*coll_ptr[i])->numcompute)
+            if(numcomm[k] + numcompute[k])
               CommBench::print_lib((*coll_ptr[i])->lib);
             else
               switch((*coll_ptr[i])->lib) {
@@ -136,8 +251,8 @@
                 case CommBench::XCCL    : printf(" X "); break;
                 case CommBench::numlib  : printf(" NUMLIB "); break;
               }
-            if((*coll_ptr[i])->numcompute)
-              printf(" %d |", (*coll_ptr[i])->numcompute);
+            if(numcompute[k])
+              printf(" %ld |", numcompute[k]);
             else
               printf("   |");
             coll_ptr[i]++;
@@ -150,4 +265,3 @@
       printf("\n");
     }
   }
-
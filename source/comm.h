@@ -13,31 +13,98 @@
  * limitations under the License.
  */
 
-  template <typename T>
+  template <typename T, typename A = typename accumulator<T>::type>
   class Comm {
 
     // PRIMITIVES
     std::vector<std::vector<BROADCAST<T>>> bcast_epoch;
     std::vector<std::vector<REDUCE<T>>> reduce_epoch;
+    std::vector<std::vector<BULK<T>>> bulk_epoch;
     int numepoch = 0;
 
     // HiCCL PARAMETERS
     std::vector<int> hierarchy = {numproc};
     std::vector<CommBench::library> library = {CommBench::MPI};
+    std::vector<size_t> threshold;
+    std::vector<CommBench::library> library_small;
+    std::vector<CommBench::library> library_large;
+    std::vector<int> codec;
+    std::vector<int> codec_reduce;
+    std::vector<bool> aggregate; // all-to-all messages per pair of subgroups instead of peers, per level
+    std::vector<int> incast; // senders per receiver and step, per level (0: unlimited)
+    bool feedback = false;
+    bool reproducible = false;
+    int numpiece = 0;
+    int progress = ordered;
+    std::vector<std::shared_ptr<Worker>> worker; // one thread per lane for polling and threaded progress
+    std::vector<int> cores; // of the lane threads
     int numstripe = 1;
+    std::vector<int> numstripe_level; // per level (the first is numstripe), e.g., dies or bridges within a node
+    std::vector<double> weight; // of the processes in striping (empty: equal)
+    size_t probe = 0; // bytes per process to measure the weights at init (0: do not measure)
     int ringnodes = 1;
     int pipedepth = 1;
+    int numbound = 8; // pipelines kept for other user buffers than the endpoints
+    int numinstance = 4; // counts kept planned besides maxcount
+    std::vector<size_t> mtu; // message size per level in bytes, replaces pipedepth (empty: pipedepth equal pieces)
+    size_t align = 64; // of the chunk boundaries in bytes
+    int mtu_batch = 0; // number of batches of the maximum-size plan
+    int scheduler = staggered;
+    Cost cost; // of the lanes for the makespan scheduler
+    int numthread = 1; // planning the batches of an epoch in parallel
+    bool local = false; // each process materializes the transfers and computations it takes part in only
+    bool balance = false; // reducers and forwarders by load instead of local index
+    std::vector<size_t> proc_load; // bytes received and reduced per process in the plan (when balanced)
+    std::vector<std::vector<size_t>> load_batch; // of the batches of the epoch being planned
     // ENDPOINTS
     T *sendbuf = nullptr;
     T *recvbuf = nullptr;
     size_t sendcount = 0;
     size_t recvcount = 0;
+    // FUSED PLANS
+    std::vector<Comm<T, A>*> fused;
+    std::vector<int> batchoffset;
+    // SCHEDULE
+    std::vector<int> passes;
+    std::string dumpfile;
+    std::string loadfile;
+    std::vector<T*> loaduser;
+    // COUNT-PARAMETRIC PLANS
+    size_t maxcount = 0;
+    size_t count = 0;
+    std::vector<std::pair<void*, size_t>> buffers; // intermediate buffers of the maximum-size plan
+    std::vector<std::pair<void*, size_t>> scratch; // intermediate buffers of this and the fused plans (for quantized partial sums)
 
     public:
 
     // PIPELINE
-    std::vector<std::list<Command<T>>> command_batch;
+    std::vector<std::list<Command<T, A>>> command_batch;
     std::vector<std::list<Coll<T>*>> coll_batch;
+    std::vector<std::list<Coll<T>*>> coll_pipeline;
+
+    // ENDPOINT REBINDING
+    std::vector<std::vector<int>> endpoint_step; // per lane and step: 1 communication, 2 computation touches the endpoints (on any process)
+    std::deque<std::vector<std::list<Command<T, A>>>> command_bound; // pipelines rebound to user buffers (stable for requests in flight)
+    std::map<std::pair<T*, T*>, int> bound_id; // user buffers -> pipeline (0 is command_batch)
+    std::vector<std::pair<T*, T*>> bound_key; // user buffers of each bound pipeline
+    std::vector<unsigned long> bound_use; // last use of each bound pipeline (the least recently used is released)
+    unsigned long bound_clock = 0;
+    unsigned long bound_generation = 0; // pipelines built so far (the same on all processes, checked at each build)
+
+    // PIPELINES OF A COUNT-PARAMETRIC PLAN (ONE PER COUNT)
+    struct INSTANCE {
+      unsigned long use = 0; // last selection
+      std::vector<std::list<Command<T, A>>> command_batch;
+      std::vector<std::list<Coll<T>*>> coll_pipeline;
+      std::vector<std::vector<int>> endpoint_step;
+      std::deque<std::vector<std::list<Command<T, A>>>> command_bound;
+      std::map<std::pair<T*, T*>, int> bound_id;
+      std::vector<std::pair<T*, T*>> bound_key;
+      std::vector<unsigned long> bound_use;
+      unsigned long bound_generation = 0;
+    };
+    std::map<size_t, INSTANCE> instance; // other than the selected count
+    unsigned long instance_clock = 0;
 
     // SETTERS
     void set_hierarchy(std::vector<int> hierarchy, std::vector<CommBench::library> library) {
@@ -51,15 +118,337 @@
         this->library = library;
       }
     }
+    // MESSAGE-SIZE-AWARE LIBRARY PER LEVEL: TRANSFERS BELOW THRESHOLD (BYTES) USE library_small, OTHERS USE library_large
+    // (THE LIBRARY OF set_hierarchy STAYS FOR THE LEVELS WITHOUT A THRESHOLD)
+    void set_threshold(std::vector<size_t> threshold, std::vector<CommBench::library> library_small, std::vector<CommBench::library> library_large) {
+      if(threshold.size() != hierarchy.size() || library_small.size() != hierarchy.size() || library_large.size() != hierarchy.size()) {
+        if(myid == printid)
+          printf("threshold and libraries must have the same size as hierarchy!\n");
+        return;
+      }
+      else {
+        this->threshold = threshold;
+        this->library_small = library_small;
+        this->library_large = library_large;
+      }
+    }
+    // LOSSLESS COMPRESSION OF TRANSFERS ACROSS PROCESSES ON CHOSEN LEVELS (e.g., INTER-NODE)
+    void set_compression(std::vector<bool> compress) {
+      if(compress.size() != hierarchy.size()) {
+        if(myid == printid)
+          printf("compression must have the same size as hierarchy!\n");
+        return;
+      }
+      codec.resize(hierarchy.size(), raw);
+      for(int i = 0; i < hierarchy.size(); i++)
+        codec[i] = (compress[i] ? lossless : raw);
+    }
+    // AGGREGATION OF BULK ALL-TO-ALL ON CHOSEN LEVELS (e.g., INTER-NODE): ONE MESSAGE PER PAIR OF SUBGROUPS THROUGH PROXIES THAT
+    // PACK AND UNPACK WITHIN THE SUBGROUPS, INSTEAD OF ONE PER PAIR OF PEERS (FEWER, LARGER MESSAGES FOR SMALL BLOCKS)
+    void set_aggregation(std::vector<bool> aggregate) {
+      if(aggregate.size() != hierarchy.size()) {
+        if(myid == printid)
+          printf("aggregation must have the same size as hierarchy!\n");
+        return;
+      }
+      this->aggregate = aggregate;
+    }
+    // INCAST LIMIT ON CHOSEN LEVELS: STEPS WHERE A PROCESS RECEIVES FROM MORE THAN fanin[level] PROCESSES (e.g., THE ROOT OF A
+    // GATHER OR THE TOP OF A REDUCTION TREE) ARE SPLIT INTO SUCCESSIVE ROUNDS OF AT MOST fanin[level] SENDERS PER RECEIVER
+    // (0: UNLIMITED). The rounds need all transfers on all processes, local materialization is turned off.
+    void set_incast(std::vector<int> fanin) {
+      if(fanin.size() != hierarchy.size()) {
+        if(myid == printid)
+          printf("incast must have the same size as hierarchy!\n");
+        return;
+      }
+      incast.clear();
+      if(std::any_of(fanin.begin(), fanin.end(), [] (int limit) { return limit > 0; }))
+        incast = fanin;
+    }
+    // LOSSY QUANTIZATION (quantize8 OR bfloat16) OF PARTIAL SUMS SENT ACROSS PROCESSES BY REDUCTIONS ON CHOSEN LEVELS
+    // WITH feedback, EACH PROCESS KEEPS THE ROUNDING ERROR OF ITS SENDS AND ADDS IT TO THE SAME SENDS OF THE NEXT CALL
+    void set_quantization(std::vector<bool> quantize, int code = quantize8, bool feedback = true) {
+      if(quantize.size() != hierarchy.size()) {
+        if(myid == printid)
+          printf("quantization must have the same size as hierarchy!\n");
+        return;
+      }
+      if(!std::is_floating_point<T>::value || (code != quantize8 && code != bfloat16)) {
+        if(myid == printid)
+          printf("quantization requires a floating-point type and code quantize8 or bfloat16!\n");
+        return;
+      }
+      codec_reduce.resize(hierarchy.size(), raw);
+      for(int i = 0; i < hierarchy.size(); i++)
+        codec_reduce[i] = (quantize[i] ? code : raw);
+      this->feedback = feedback;
+    }
+    // BITWISE-REPRODUCIBLE REDUCTIONS: THE ORDER OF ADDITIONS DOES NOT DEPEND ON hierarchy, numstripe, ringnodes, pipedepth
+    void set_reproducible(bool reproducible) {
+      this->reproducible = reproducible;
+    }
+    // STREAMING RECEIVE-REDUCE: REMOTE INPUTS ARRIVE IN numpiece PIECES THROUGH DOUBLE-BUFFERED SCRATCH AND ARE ADDED AS THEY LAND
+    // REDUCER MEMORY PER LEVEL: 2 * count / numpiece INSTEAD OF count PER INPUT (0: RECEIVE WHOLE INPUTS, DEFAULT)
+    void set_streaming(int numpiece) {
+      if(numpiece < 0) {
+        if(myid == printid)
+          printf("number of pieces must be non-negative!\n");
+        return;
+      }
+      this->numpiece = numpiece;
+    }
+    // SCHEDULE PASSES (self_copy, redundant_copy, multicast), RUN IN THE GIVEN ORDER AFTER PLANNING
+    void set_passes(std::vector<int> passes) {
+      this->passes = passes;
+    }
+    // WRITE THE SCHEDULE TO A FILE AT init (AFTER THE PASSES)
+    void set_dump(std::string filename) {
+      dumpfile = filename;
+    }
+    // PLAN FROM A SCHEDULE FILE INSTEAD OF THE PRIMITIVES AT init, user BINDS u0, u1, ... ON EACH PROCESS
+    // (BY DEFAULT THE BUFFERS OF THE PRIMITIVES IN ORDER OF FIRST APPEARANCE)
+    void load(std::string filename, std::vector<T*> user = std::vector<T*>()) {
+      loadfile = filename;
+      loaduser = user;
+    }
+    // PROGRESS MODE OF run(): ordered (DEFAULT), polling OR threaded, LANE THREADS ARE PINNED TO cores (ROUND ROBIN) IF GIVEN
+    // MPI MUST BE INITIALIZED WITH MPI_THREAD_MULTIPLE FOR polling AND threaded (MPI_Init_thread BEFORE CommBench::init)
+    void set_progress(int progress, std::vector<int> cores = std::vector<int>()) {
+      int provided;
+      MPI_Query_thread(&provided);
+      if(progress != ordered && provided < MPI_THREAD_MULTIPLE) {
+        if(myid == printid)
+          printf("progress mode requires MPI_THREAD_MULTIPLE, keeping ordered progress!\n");
+        return;
+      }
+      this->progress = progress;
+      this->cores = cores;
+      worker.clear();
+    }
     void set_pipedepth(int pipedepth) {
       this->pipedepth = pipedepth;
     }
+    // PIPELINE BY MESSAGE SIZE: THE LARGEST mtu (BYTES) SETS THE PIPELINE CHUNK, AND THE TRANSFERS OF EACH LEVEL ARE SPLIT FURTHER TO ITS mtu
+    // (e.g., LARGE MESSAGES ACROSS NODES AND SMALL ONES WITHIN), CHUNKS ARE MULTIPLES OF align BYTES (CACHE LINE OR PAGE), 0 DOES NOT SPLIT A LEVEL
+    void set_mtu(std::vector<size_t> mtu, size_t align = 64) {
+      if(mtu.size() != hierarchy.size() || align == 0) {
+        if(myid == printid)
+          printf("mtu must have the same size as hierarchy and align must be positive!\n");
+        return;
+      }
+      this->mtu = mtu;
+      this->align = align;
+    }
+    // PLACEMENT OF THE BATCH STEPS: staggered (DEFAULT) OR makespan (LIST SCHEDULING BY ESTIMATED COST, REPORTS THE BUBBLE FRACTION)
+    void set_scheduler(int scheduler) {
+      this->scheduler = scheduler;
+    }
+    // COST MODEL OF A LIBRARY FOR THE makespan SCHEDULER (e.g., FROM Command::measure), latency IN SECONDS, bandwidth IN BYTES PER SECOND
+    void set_cost(CommBench::library lib, double latency, double bandwidth) {
+      if(latency < 0 || bandwidth <= 0) {
+        if(myid == printid)
+          printf("latency must be non-negative and bandwidth positive!\n");
+        return;
+      }
+      cost.latency[lib] = latency;
+      cost.bandwidth[lib] = bandwidth;
+    }
+    // REDUCTION THROUGHPUT FOR THE makespan SCHEDULER IN BYTES OF INPUT PER SECOND
+    void set_cost_compute(double bandwidth) {
+      if(bandwidth > 0)
+        cost.compute = bandwidth;
+    }
+    // PLAN THE (INDEPENDENT) BATCHES ON numthread THREADS AT init, THE PLAN DOES NOT DEPEND ON numthread
+    void set_planner_threads(int numthread) {
+      if(numthread < 1) {
+        if(myid == printid)
+          printf("number of planner threads must be positive!\n");
+        return;
+      }
+      this->numthread = numthread;
+    }
+    // LOCAL MATERIALIZATION: EACH PROCESS KEEPS ONLY THE TRANSFERS AND REDUCTIONS IT TAKES PART IN (MEMORY AND init TIME DO NOT GROW
+    // WITH THE TRANSFERS OF OTHER PROCESSES), THE GLOBAL REPORTS ARE REDUCED ON DEMAND AND run() SKIPS STEPS WITHOUT WORK OF THE PROCESS
+    // SCHEDULE PASSES AND DUMPS NEED ALL TRANSFERS ON ALL PROCESSES AND MATERIALIZE GLOBALLY
+    void set_local(bool local) {
+      this->local = local;
+    }
+    // LOAD-BALANCED REDUCERS AND FORWARDERS (ranks.h): THE TREES AND THE RING REDUCE AND FORWARD THROUGH THE SENDERS AND RECEIVERS
+    // OF EACH PRIMITIVE WITH THE FEWEST BYTES ASSIGNED IN THE EPOCH INSTEAD OF THE PROCESS WITH THE SAME LOCAL INDEX, AND init
+    // REPORTS THE LOAD PER PROCESS WITHOUT AND WITH BALANCING
+    void set_balance(bool balance) {
+      this->balance = balance;
+    }
+    // ELEMENTS PER CHUNK OF AT MOST bytes (AT LEAST ONE ALIGNMENT UNIT)
+    size_t mtu_count(size_t bytes) {
+      size_t unit = 1;
+      while((unit * sizeof(T)) % align)
+        unit++;
+      return std::max(unit, bytes / sizeof(T) / unit * unit);
+    }
     void set_numstripe(int numstripe) {
       this->numstripe = numstripe;
+      numstripe_level.clear();
+    }
+    // STRIPING AT EVERY LEVEL: PRIMITIVES CROSSING LEVEL i (AND NO LEVEL ABOVE) ARE SPLIT OVER numstripe[i] CONSECUTIVE PROCESSES
+    // numstripe[0] STRIPES ACROSS NODES AS ABOVE, numstripe[i] MUST DIVIDE THE GROUP SIZE OF LEVEL i + 1 (THE LEAF LEVEL TAKES 1)
+    void set_numstripe(std::vector<int> numstripe) {
+      if(numstripe.size() != hierarchy.size()) {
+        if(myid == printid)
+          printf("numstripe must have the same size as hierarchy!\n");
+        return;
+      }
+      this->numstripe = numstripe[0];
+      numstripe_level = numstripe;
+    }
+    // WEIGHTED STRIPING: SPLITS OF AN INTER-NODE PRIMITIVE ARE PROPORTIONAL TO THE WEIGHTS OF THE STRIPE PROCESSES (e.g., NIC BANDWIDTH)
+    // weight HAS numproc ENTRIES OR numstripe ENTRIES (THE SAME ON EVERY NODE), ZERO KEEPS A PROCESS (e.g., ON A SHARED NIC) OUT OF STRIPING
+    void set_stripe_weights(std::vector<double> weight) {
+      for(auto &w : weight)
+        if(w < 0) {
+          if(myid == printid)
+            printf("stripe weights must be non-negative!\n");
+          return;
+        }
+      this->weight = weight;
+      probe = 0;
+    }
+    // MEASURE THE STRIPE WEIGHTS AT init: ALL PROCESSES SEND bytes TO THE SAME STRIPE OF THE NEXT NODE AT ONCE (SO THAT SHARED NICS SHOW UP)
+    // AND THE WEIGHT OF A PROCESS IS ITS ACHIEVED BANDWIDTH
+    void measure_stripe_weights(size_t bytes = 1 << 24) {
+      probe = bytes;
+    }
+    // PIPELINES KEPT FOR CALLS WITH OTHER USER BUFFERS THAN THE ENDPOINTS (THE LEAST RECENTLY USED IS RELEASED BEYOND)
+    // Each new pair of user buffers (and each pair bound again after its release) builds a pipeline: new communicators for the
+    // commands that touch the endpoints, which exchange memory handles (IPC) and cost about as much as these commands at init.
+    // Calls with a bound pair take no communication. Keep numbound at least the number of pairs used in turn.
+    void set_numbound(int numbound) {
+      this->numbound = std::max(numbound, 1);
     }
     void set_ringnodes(int ringnodes) {
       this->ringnodes = ringnodes;
     }
+    // COUNT-PARAMETRIC PLAN: COUNTS AND OFFSETS OF THE PRIMITIVES ARE GIVEN FOR maxcount AND TAKEN AS q * maxcount + r
+    void set_maxcount(size_t maxcount) {
+      this->maxcount = maxcount;
+      this->count = maxcount;
+    }
+    // COUNTS OF A COUNT-PARAMETRIC PLAN KEPT PLANNED BESIDES maxcount (THE LEAST RECENTLY SELECTED IS RELEASED BEYOND)
+    // A released count is planned again at its next selection, at about the cost of init: keep numinstance at least the number
+    // of counts used in turn.
+    void set_numinstance(int numinstance) {
+      this->numinstance = std::max(numinstance, 1);
+    }
+    // SELECT THE COUNT OF A COUNT-PARAMETRIC PLAN (COLLECTIVE, AFTER init), RETURNS false ON ERROR (THE COUNT IS NOT CHANGED)
+    // All processes call it with the same count. The first selection of a count (and the first after its release, see
+    // set_numinstance) costs about an init: it plans and implements the count, builds its communicators (exchanging memory
+    // handles) with the buffers of the maximum-size plan, and synchronizes the processes. Selecting a kept count swaps the
+    // pipelines without communication. Offsets are not evaluated at start: each count has its own pipelines.
+    bool set_count(size_t count) {
+      if(maxcount == 0 || count > maxcount || fused.size()) {
+        if(myid == printid)
+          printf("ERROR!!! count %zu is not supported (maxcount %zu, %zu fused plans).\n", count, maxcount, fused.size());
+        return false;
+      }
+      pthread_mutex_lock(&bind_mutex);
+      if(count != this->count)
+        select_count(count);
+      pthread_mutex_unlock(&bind_mutex);
+      return true;
+    }
+    void select_count(size_t count) {
+      drain(this);
+      swap(instance[this->count]);
+      instance[this->count].use = ++instance_clock;
+      this->count = count;
+      auto it = instance.find(count);
+      if(it != instance.end()) {
+        swap(it->second);
+        instance.erase(it);
+        find_pairs();
+        return;
+      }
+      // RELEASE THE LEAST RECENTLY SELECTED COUNT (THE SAME ON ALL PROCESSES)
+      size_t kept = instance.size() - instance.count(maxcount);
+      if(kept >= numinstance) {
+        auto victim = instance.end();
+        for(auto it = instance.begin(); it != instance.end(); it++)
+          if(it->first != maxcount && (victim == instance.end() || it->second.use < victim->second.use))
+            victim = it;
+        release(victim->second);
+        instance.erase(victim);
+      }
+      // PLAN FOR THE NEW COUNT WITH THE BUFFERS OF THE MAXIMUM-SIZE PLAN
+      MPI_Barrier(comm_mpi);
+      double time = MPI_Wtime();
+      std::vector<std::vector<BROADCAST<T>>> bcast_epoch_temp = bcast_epoch;
+      std::vector<std::vector<REDUCE<T>>> reduce_epoch_temp = reduce_epoch;
+      std::vector<std::vector<BULK<T>>> bulk_epoch_temp = bulk_epoch;
+      for(auto &bcastlist : bcast_epoch)
+        for(auto &bcast : bcastlist) {
+          bcast.sendoffset = scale(bcast.sendoffset);
+          bcast.recvoffset = scale(bcast.recvoffset);
+          bcast.count = scale(bcast.count);
+        }
+      for(auto &reducelist : reduce_epoch)
+        for(auto &reduce : reducelist) {
+          reduce.sendoffset = scale(reduce.sendoffset);
+          reduce.recvoffset = scale(reduce.recvoffset);
+          reduce.count = scale(reduce.count);
+        }
+      for(auto &bulklist : bulk_epoch)
+        for(auto &bulk : bulklist) {
+          bulk.sendoffset = scale(bulk.sendoffset);
+          bulk.recvoffset = scale(bulk.recvoffset);
+          bulk.count = scale(bulk.count);
+          bulk.stride = scale(bulk.stride);
+        }
+      std::vector<std::list<Coll<T>*>> coll_batch_temp;
+      std::vector<int> batchoffset_temp;
+      std::swap(coll_batch, coll_batch_temp);
+      std::swap(batchoffset, batchoffset_temp);
+      size_t reuse_temp = reuse;
+      size_t recycle_temp = recycle;
+      int printid_temp = printid;
+      int printid_commbench = CommBench::printid;
+      printid = -1;
+      CommBench::printid = -1;
+      buffer_replay = &buffers;
+      buffer_next = 0;
+      plan();
+      implement(coll_batch, command_batch, coll_pipeline, batchoffset, threshold, library_small, library_large, codec, codec_reduce, feedback, scheduler == makespan ? &cost : nullptr);
+      fuse_quantized(command_batch, coll_pipeline, scratch);
+      isolate();
+      find_pairs();
+      buffer_replay = nullptr;
+      printid = printid_temp;
+      CommBench::printid = printid_commbench;
+      reuse = reuse_temp;
+      recycle = recycle_temp;
+      std::swap(coll_batch, coll_batch_temp);
+      std::swap(batchoffset, batchoffset_temp);
+      std::swap(bcast_epoch, bcast_epoch_temp);
+      std::swap(reduce_epoch, reduce_epoch_temp);
+      std::swap(bulk_epoch, bulk_epoch_temp);
+      MPI_Barrier(comm_mpi);
+      if(myid == printid)
+        printf("count %zu of maxcount %zu planned in %e seconds\n", count, maxcount, MPI_Wtime() - time);
+    }
+    size_t scale(size_t value) {
+      return value / maxcount * count + value % maxcount;
+    }
+    void swap(INSTANCE &instance) {
+      std::swap(command_batch, instance.command_batch);
+      std::swap(coll_pipeline, instance.coll_pipeline);
+      std::swap(endpoint_step, instance.endpoint_step);
+      std::swap(command_bound, instance.command_bound);
+      std::swap(bound_id, instance.bound_id);
+      std::swap(bound_key, instance.bound_key);
+      std::swap(bound_use, instance.bound_use);
+      std::swap(bound_generation, instance.bound_generation);
+    }
+
     // SET ENDPOINTS
     void set_endpoints(T *sendbuf, size_t sendcount, T *recvbuf, size_t recvcount) {
       this->sendbuf = sendbuf;
@@ -75,23 +464,89 @@
         for(int i = 0; i < hierarchy.size(); i++) {
           printf("  level %d factor: %d library: ", i, hierarchy[i]);
           CommBench::print_lib(library[i]);
+          if(i < threshold.size() && threshold[i]) {
+            printf(" below ");
+            CommBench::print_data(threshold[i]);
+            printf(": ");
+            CommBench::print_lib(library_small[i]);
+            printf(", above: ");
+            CommBench::print_lib(library_large[i]);
+          }
+          if(i < codec.size() && codec[i] == lossless)
+            printf(" compressed");
+          if(i < aggregate.size() && aggregate[i])
+            printf(" aggregated");
+          if(i < incast.size() && incast[i])
+            printf(" incast %d", incast[i]);
+          if(i < codec_reduce.size() && codec_reduce[i] != raw)
+            printf(" quantized (%s%s)", codec_reduce[i] == quantize8 ? "8-bit" : "bfloat16", feedback ? ", error feedback" : "");
 	  if(hierarchy[0] == numproc && library[0] == CommBench::MPI)
             printf(" (default)\n");
           else
             printf("\n");
         }
         printf("numstripe: %d", numstripe);
-        if(numstripe == 1)
+        for(int level = 1; level < numstripe_level.size(); level++)
+          printf(" %d", numstripe_level[level]);
+        if(numstripe_level.size() > 1)
+          printf(" (per level)\n");
+        else if(numstripe == 1)
           printf(" (default)\n");
         else
           printf("\n");
+        printf("stripe weights:");
+        if(weight.size()) {
+          for(int p = 0; p < weight.size(); p++)
+            printf("%s %.3g", p % numstripe ? "" : (p ? " |" : ""), weight[p]);
+          printf("%s\n", probe ? " (measured)" : "");
+        }
+        else
+          printf(" equal (default)\n");
         printf("ringnodes: %d", ringnodes);
         if(ringnodes == 1)
           printf(" (default)\n");
         else
           printf("\n");
-        printf("pipedepth: %d", pipedepth);
-        if(pipedepth == 1)
+        if(mtu.size()) {
+          printf("mtu:");
+          for(auto &bytes : mtu)
+            printf(" %zu", bytes);
+          printf(" bytes (aligned to %zu bytes)\n", align);
+        }
+        else {
+          printf("pipedepth: %d", pipedepth);
+          if(pipedepth == 1)
+            printf(" (default)\n");
+          else
+            printf("\n");
+        }
+        printf("scheduler: %s\n", scheduler == makespan ? "makespan" : "staggered (default)");
+        printf("planner threads: %d%s\n", numthread, numthread == 1 ? " (default)" : "");
+        printf("materialization: %s\n", local ? "local" : "global (default)");
+        printf("reducers and forwarders: %s\n", balance ? "balanced" : "by local index (default)");
+        printf("progress: %s", progress == threaded ? "threaded" : (progress == polling ? "polling" : "ordered (default)"));
+        if(progress != ordered && cores.size()) {
+          printf(" cores:");
+          for(auto &core : cores)
+            printf(" %d", core);
+        }
+        printf("\n");
+        printf("reproducible: %s", reproducible ? "yes (canonical reduction tree, striping and ring apply to broadcasts only)\n" : "no (default)\n");
+        printf("schedule passes:");
+        for(auto &p : passes)
+          printf(" %s", p == self_copy ? "self_copy" : (p == redundant_copy ? "redundant_copy" : "multicast"));
+        printf(passes.size() ? "\n" : " none (default)\n");
+        if(loadfile.size())
+          printf("schedule loaded from %s\n", loadfile.c_str());
+        if(dumpfile.size())
+          printf("schedule dumped to %s\n", dumpfile.c_str());
+        printf("streaming: %d", numpiece);
+        if(numpiece == 0)
+          printf(" (default)\n");
+        else
+          printf(" pieces per input\n");
+        printf("maxcount: %zu", maxcount);
+        if(maxcount == 0)
           printf(" (default)\n");
         else
           printf("\n");
@@ -112,6 +567,7 @@
     void add_fence() {
       bcast_epoch.push_back(std::vector<BROADCAST<T>>());
       reduce_epoch.push_back(std::vector<REDUCE<T>>());
+      bulk_epoch.push_back(std::vector<BULK<T>>());
       if(myid == printid)
         printf("Add epoch %d\n", numepoch);
       numepoch++;
@@ -155,9 +611,45 @@
       reduce_epoch.back().back().report();
     }
 
+    // BULK PRIMITIVES (bulk.h): EACH PROCESS s SENDS BLOCK r (sendoffset + r * count) TO PROCESS r (recvoffset + s * count)
+    void add_alltoall(T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count) {
+      bulk_epoch.back().push_back(BULK<T>(alltoall, sendbuf, sendoffset, recvbuf, recvoffset, count, count));
+      bulk_epoch.back().back().report();
+    }
+    // EACH PROCESS s SENDS ITS BLOCK (sendoffset) TO ALL PROCESSES (recvoffset + s * count)
+    void add_allgather(T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count) {
+      bulk_epoch.back().push_back(BULK<T>(allgather, sendbuf, sendoffset, recvbuf, recvoffset, count, count));
+      bulk_epoch.back().back().report();
+    }
+    // EACH PROCESS s SENDS ITS BLOCK (sendoffset) TO root (recvoffset + s * count), ONE MESSAGE PER SUBGROUP ON EACH LEVEL
+    void add_gather(T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count, int root) {
+      bulk_epoch.back().push_back(BULK<T>(gather, sendbuf, sendoffset, recvbuf, recvoffset, count, count, root));
+      bulk_epoch.back().back().report();
+    }
+
+    // FUSE ANOTHER PLAN INTO THIS ONE (e.g., GRADIENT BUCKETS)
+    // The fused plan is planned with its own parameters, its batches are interleaved lane by lane with the batches of this plan,
+    // and the start() / wait() of this plan drives all of them. Message-size thresholds of this plan apply to all fused plans.
+    void fuse(Comm<T, A> &comm) {
+      if(&comm == this) {
+        if(myid == printid)
+          printf("cannot fuse a plan into itself!\n");
+        return;
+      }
+      fused.push_back(&comm);
+    }
+
 #include "init.h"
 
-    void init() {
+    void plan() {
+      if(weight.size() == numstripe && numstripe < numproc)
+        for(int p = numstripe; p < numproc; p++)
+          weight.push_back(weight[p % numstripe]);
+      if(weight.size() && weight.size() != numproc) {
+        if(myid == printid)
+          printf("stripe weights must have numproc or numstripe entries, striping equally!\n");
+        weight.clear();
+      }
       if(myid == printid) {
         printf("FINAL PARAMETERS\n");
         print_parameters();
@@ -169,17 +661,229 @@
       for(int i = numlevel - 2; i > -1; i--)
         groupsize[i] = groupsize[i + 1] * hierarchy[i];
       groupsize[0] = numproc / ringnodes;
-      MPI_Barrier(comm_mpi);
-      double init_time = MPI_Wtime();
+      // STRIPES PER LEVEL
+      std::vector<int> stripes(numlevel, 1);
+      stripes[0] = numstripe;
+      for(int level = 1; level < numlevel && level < numstripe_level.size(); level++) {
+        int below = (level + 1 < numlevel ? groupsize[level + 1] : 1);
+        if(numstripe_level[level] < 1 || below % numstripe_level[level]) {
+          if(myid == printid)
+            printf("numstripe %d does not divide the group size %d below level %d, not striping the level!\n", numstripe_level[level], below, level);
+          continue;
+        }
+        stripes[level] = numstripe_level[level];
+      }
+      // PIPELINE CHUNK (SMALLER COUNTS OF A COUNT-PARAMETRIC PLAN KEEP THE BATCHES OF maxcount)
+      int numbatch = pipedepth;
+      size_t chunk = 0;
+      if(mtu.size() && *std::max_element(mtu.begin(), mtu.end())) {
+        chunk = mtu_count(*std::max_element(mtu.begin(), mtu.end()));
+        if(buffer_replay == nullptr) {
+          mtu_batch = 1;
+          for(int epoch = 0; epoch < numepoch; epoch++) {
+            for(auto &bcast : bcast_epoch[epoch])
+              mtu_batch = std::max(mtu_batch, (int)((bcast.count + chunk - 1) / chunk));
+            for(auto &reduce : reduce_epoch[epoch])
+              mtu_batch = std::max(mtu_batch, (int)((reduce.count + chunk - 1) / chunk));
+            for(auto &bulk : bulk_epoch[epoch])
+              mtu_batch = std::max(mtu_batch, (int)((bulk.count + chunk - 1) / chunk));
+          }
+          if(myid == printid)
+            printf("pipeline chunk %zu elements (%zu bytes), %d batches\n", chunk, chunk * sizeof(T), mtu_batch);
+        }
+        numbatch = mtu_batch;
+      }
       // init.h
-      init(numlevel, groupsize.data(), library.data(), numstripe, pipedepth);
+      Options options;
+      options.parametric = (maxcount > 0);
+      options.streaming = numpiece;
+      options.local = local;
+      options.stripe_weight = weight;
+      if(local && loadfile.empty() && (passes.size() || dumpfile.size())) {
+        if(myid == printid)
+          printf("schedule passes and dumps need all transfers on all processes, materializing globally!\n");
+        options.local = false;
+      }
+      if(options.local && loadfile.empty() && incast.size()) {
+        if(myid == printid)
+          printf("incast limits need all transfers on all processes, materializing globally!\n");
+        options.local = false;
+      }
+      if(options.parametric && buffer_replay == nullptr)
+        buffer_record = &buffers;
+      std::vector<std::pair<void*, size_t>> scratch;
+      buffer_scratch = &scratch;
+      Schedule<T> schedule;
+      if(loadfile.size()) {
+        if(schedule.load(loadfile)) {
+          schedule.user_ptr = (loaduser.size() ? loaduser : user_buffers());
+          schedule.optimize(passes);
+          schedule.raise(coll_batch, batchoffset, options.local);
+        }
+      }
+      else {
+        // LOADS WITHOUT BALANCING FOR THE REPORT (DRY PLAN)
+        std::vector<size_t> load_default;
+        if(balance && printid > -1 && buffer_replay == nullptr) {
+          std::vector<std::list<Coll<T>*>> coll_batch_temp;
+          std::vector<int> batchoffset_temp;
+          std::swap(coll_batch, coll_batch_temp);
+          std::swap(batchoffset, batchoffset_temp);
+          size_t reuse_temp = reuse;
+          size_t recycle_temp = recycle;
+          int printid_temp = printid;
+          printid = -1;
+          buffer_dry = true;
+          plan(numlevel, groupsize.data(), library.data(), stripes.data(), numbatch, chunk, options);
+          buffer_dry = false;
+          printid = printid_temp;
+          reuse = reuse_temp;
+          recycle = recycle_temp;
+          for(auto &coll_list : coll_batch)
+            for(auto &coll : coll_list)
+              delete coll;
+          std::swap(coll_batch, coll_batch_temp);
+          std::swap(batchoffset, batchoffset_temp);
+          load_default.swap(proc_load);
+        }
+        balanced = balance && !options.parametric;
+        if(balance && options.parametric && buffer_replay == nullptr && myid == printid)
+          printf("count-parametric plans replay the buffers of the maximum-size plan, not balancing!\n");
+        plan(numlevel, groupsize.data(), library.data(), stripes.data(), numbatch, chunk, options);
+        balanced = false;
+        if(load_default.size())
+          report_load(load_default, proc_load);
+        if(passes.size() || dumpfile.size()) {
+          std::vector<T*> user = user_buffers();
+          schedule.lower(coll_batch, batchoffset, scratch, user);
+          schedule.optimize(passes);
+          schedule.raise(coll_batch, batchoffset);
+        }
+      }
+      if(dumpfile.size() && buffer_replay == nullptr)
+        schedule.dump(dumpfile);
+      for(auto &buffer : scratch)
+        if(std::find(this->scratch.begin(), this->scratch.end(), buffer) == this->scratch.end())
+          this->scratch.push_back(buffer);
+      buffer_scratch = nullptr;
+      buffer_record = nullptr;
+    }
+
+    // ACHIEVED BANDWIDTH OF EACH PROCESS WHEN ALL SEND TO THE NEXT NODE AT ONCE
+    void measure_weights() {
+      int nodesize = numstripe;
+      if(numproc <= nodesize || numproc % nodesize)
+        return;
+      char *sendbuf;
+      char *recvbuf;
+      CommBench::allocate(sendbuf, probe);
+      CommBench::allocate(recvbuf, probe);
+      CommBench::Comm<char> probe_comm(library[0]);
+      for(int p = 0; p < numproc; p++)
+        probe_comm.add(sendbuf, 0, recvbuf, 0, probe, p, (p + nodesize) % numproc);
+      double minTime = 0;
+      for(int iter = -1; iter < 5; iter++) {
+        MPI_Barrier(comm_mpi);
+        double time = MPI_Wtime();
+        probe_comm.start();
+        probe_comm.wait();
+        time = MPI_Wtime() - time;
+        if(iter == 0 || (iter > 0 && time < minTime))
+          minTime = time;
+      }
+      double bandwidth = probe / minTime;
+      weight.resize(numproc);
+      MPI_Allgather(&bandwidth, 1, MPI_DOUBLE, weight.data(), 1, MPI_DOUBLE, comm_mpi);
+      CommBench::free(sendbuf);
+      CommBench::free(recvbuf);
+      if(myid == printid) {
+        printf("stripe bandwidth (GB/s):");
+        for(int p = 0; p < numproc; p++)
+          printf(" %.2f", weight[p] / 1e9);
+        printf("\n");
+      }
+    }
+
+    // USER BUFFERS OF THIS PROCESS IN THE PRIMITIVES (IN ORDER OF FIRST APPEARANCE)
+    std::vector<T*> user_buffers() {
+      std::vector<T*> user;
+      auto add = [&] (T *ptr) {
+        if(std::find(user.begin(), user.end(), ptr) == user.end())
+          user.push_back(ptr);
+      };
+      for(int epoch = 0; epoch < numepoch; epoch++) {
+        for(auto &bcast : bcast_epoch[epoch]) {
+          add(bcast.sendbuf);
+          add(bcast.recvbuf);
+        }
+        for(auto &reduce : reduce_epoch[epoch]) {
+          add(reduce.sendbuf);
+          add(reduce.recvbuf);
+        }
+        for(auto &bulk : bulk_epoch[epoch]) {
+          add(bulk.sendbuf);
+          add(bulk.recvbuf);
+        }
+      }
+      return user;
+    }
+
+    void init() {
       MPI_Barrier(comm_mpi);
-      if(myid == printid)
-        printf("initialization time: %e seconds\n", MPI_Wtime() - init_time);
+      double init_time = MPI_Wtime();
+      long init_resident = resident_bytes();
+      if(probe)
+        measure_weights();
+      // THRESHOLDS MUST MATCH THE FINAL HIERARCHY (set_hierarchy MAY COME AFTER set_threshold)
+      if(threshold.size() && (threshold.size() != hierarchy.size() || library_small.size() != hierarchy.size() || library_large.size() != hierarchy.size())) {
+        if(myid == printid)
+          printf("ERROR!!! thresholds are set for %zu levels but the hierarchy has %zu, ignoring the thresholds.\n", threshold.size(), hierarchy.size());
+        threshold.clear();
+        library_small.clear();
+        library_large.clear();
+      }
+      plan();
+      // MERGE FUSED PLANS (EACH IS STAGGERED WITHIN ITSELF ONLY)
+      for(auto &comm : fused) {
+        comm->plan();
+        for(int batch = 0; batch < comm->coll_batch.size(); batch++) {
+          coll_batch.push_back(comm->coll_batch[batch]);
+          batchoffset.push_back(comm->batchoffset[batch]);
+        }
+        scratch.insert(scratch.end(), comm->scratch.begin(), comm->scratch.end());
+        comm->coll_batch.clear();
+        comm->batchoffset.clear();
+      }
+      if(myid == printid && fused.size())
+        printf("fused %zu plans into %zu batches\n", fused.size() + 1, coll_batch.size());
+      // IMPLEMENT WITH COMMBENCH
+      implement(coll_batch, command_batch, coll_pipeline, batchoffset, threshold, library_small, library_large, codec, codec_reduce, feedback, scheduler == makespan ? &cost : nullptr);
+      fuse_quantized(command_batch, coll_pipeline, scratch);
+      isolate();
+      find_pairs();
+      init_resident = std::max(0L, (long) resident_bytes() - init_resident);
+      MPI_Allreduce(MPI_IN_PLACE, &init_resident, 1, MPI_LONG, MPI_MAX, comm_mpi);
+      if(myid == printid) {
+        printf("initialization time: %e seconds, resident memory (largest process): ", MPI_Wtime() - init_time);
+        CommBench::print_data(init_resident);
+        printf("\n");
+      }
     }
 
     void run() {
-      using Iter = typename std::list<Command<T>>::iterator;
+      run(command_batch);
+    }
+
+    void run(std::vector<std::list<Command<T, A>>> &command_batch) {
+      if(progress == polling) {
+        run_polling(command_batch);
+        return;
+      }
+      if(progress == threaded) {
+        run_threaded(command_batch);
+        return;
+      }
+      using Iter = typename std::list<Command<T, A>>::iterator;
       std::vector<Iter> commandptr(command_batch.size());
       for(int i = 0; i < command_batch.size(); i++)
         commandptr[i] = command_batch[i].begin();
@@ -187,43 +891,485 @@
         bool finished = true;
         for(int i = 0; i < command_batch.size(); i++)
           if(commandptr[i] != command_batch[i].end()) {
-            commandptr[i]->comm->start();
+            if(!commandptr[i]->idle()) {
+              commandptr[i]->comm->start();
+              if(commandptr[i]->compress)
+                commandptr[i]->compress->start();
+            }
             finished = false;
           }
         if(finished)
           break;
         for(int i = command_batch.size() - 1; i > -1; i--)
-          if(commandptr[i] != command_batch[i].end()) {
+          if(commandptr[i] != command_batch[i].end() && !commandptr[i]->idle()) {
             commandptr[i]->comm->wait();
+            if(commandptr[i]->compress)
+              commandptr[i]->compress->wait();
             commandptr[i]->compute->start();
           }
         for(int i = 0; i < command_batch.size(); i++)
           if(commandptr[i] != command_batch[i].end()) {
-            commandptr[i]->compute->wait();
+            if(!commandptr[i]->idle())
+              commandptr[i]->compute->wait();
             commandptr[i]++;
           }
       }
     }
 
     void run(T *sendbuf, T *recvbuf) {
-      CommBench::memcpyD2D(this->sendbuf, sendbuf, sendcount);
-      run();
-      CommBench::memcpyD2D(recvbuf, this->recvbuf, recvcount);
+      pthread_mutex_lock(&bind_mutex);
+      std::vector<std::list<Command<T, A>>> &pipeline = rebind(sendbuf, recvbuf);
+      pthread_mutex_unlock(&bind_mutex);
+      run(pipeline);
+    }
+
+    // LANES MAY SHARE A COMMUNICATOR UNDERNEATH: EVERY PROCESS STARTS THE COMMANDS WITH MESSAGES IN THE SAME (STEP, LANE)
+    // ORDER SO THAT MESSAGES MATCH, COMMANDS WITHOUT MESSAGES OF THIS PROCESS DO NOT HOLD OTHER LANES BACK
+    bool in_order(int lane, int step, std::vector<std::vector<Command<T, A>*>> &command, std::vector<int> &started) {
+      int numlane = command.size();
+      for(int l = 0; l < numlane; l++)
+        if(l != lane)
+          for(int s = started[l]; s < command[l].size() && s * numlane + l < step * numlane + lane; s++)
+            if(command[l][s]->comm->numsend + command[l][s]->comm->numrecv)
+              return false;
+      return true;
+    }
+    void lanes(std::vector<std::list<Command<T, A>>> &command_batch, std::vector<std::vector<Command<T, A>*>> &command) {
+      int numlane = command_batch.size();
+      command.resize(numlane);
+      for(int lane = 0; lane < numlane; lane++)
+        for(auto &c : command_batch[lane])
+          command[lane].push_back(&c);
+      while(worker.size() < numlane)
+        worker.push_back(std::make_shared<Worker>(cores.size() ? cores[worker.size() % cores.size()] : -1));
+    }
+
+    void run_polling(std::vector<std::list<Command<T, A>>> &command_batch) {
+      std::vector<std::vector<Command<T, A>*>> command;
+      lanes(command_batch, command);
+      int numlane = command.size();
+      std::vector<int> phase(numlane, 0); // 0: idle, 1: communication, 2: arrived
+      std::vector<bool> computing(numlane, false);
+      std::vector<int> step(numlane, 0);
+      std::vector<int> started(numlane, 0); // steps started
+      std::vector<int> arrived(numlane, 0); // steps whose communication arrived
+      std::vector<int> completed(numlane, 0); // steps completed
+      while(true) {
+        bool finished = true;
+        bool progressed = false;
+        for(int lane = 0; lane < numlane; lane++) {
+          if(step[lane] == command[lane].size())
+            continue;
+          finished = false;
+          Command<T, A> &c = *command[lane][step[lane]];
+          // NOTHING TO DO ON THIS PROCESS: COMPLETE AS SOON AS THE DEPENDENCIES ARE
+          if(phase[lane] == 0 && c.idle() && ready(c.depend, completed, step[lane])) {
+            started[lane] = arrived[lane] = completed[lane] = step[lane] + 1;
+            step[lane]++;
+            progressed = true;
+            continue;
+          }
+          if(phase[lane] == 0 && ready(c.depend, completed, step[lane]) && in_order(lane, step[lane], command, started)) {
+            c.comm->start();
+            if(c.compress)
+              c.compress->start();
+            if(c.comm->numsend + c.comm->numrecv || c.compress)
+              worker[lane]->post([&c] {
+                c.comm->wait();
+                if(c.compress)
+                  c.compress->wait();
+              });
+            started[lane] = step[lane] + 1;
+            phase[lane] = 1;
+            progressed = true;
+          }
+          if(phase[lane] == 1 && worker[lane]->done()) {
+            arrived[lane] = step[lane] + 1;
+            phase[lane] = 2;
+            progressed = true;
+          }
+          if(phase[lane] > 0 && !computing[lane] && ready(c.depend_compute, arrived, step[lane] + 1)) {
+            c.compute->start();
+            computing[lane] = true;
+            progressed = true;
+          }
+          if(phase[lane] == 2 && computing[lane] && c.compute->test()) {
+            completed[lane] = step[lane] + 1;
+            step[lane]++;
+            phase[lane] = 0;
+            computing[lane] = false;
+            progressed = true;
+          }
+        }
+        if(finished)
+          break;
+        if(!progressed)
+          sched_yield(); // leave the core to the workers
+      }
+    }
+
+    void run_threaded(std::vector<std::list<Command<T, A>>> &command_batch) {
+      std::vector<std::vector<Command<T, A>*>> command;
+      lanes(command_batch, command);
+      int numlane = command.size();
+      pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+      pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+      std::vector<int> started(numlane, 0);
+      std::vector<int> arrived(numlane, 0);
+      std::vector<int> completed(numlane, 0);
+      auto update = [&] (std::vector<int> &counter, int lane, int count) {
+        pthread_mutex_lock(&mutex);
+        counter[lane] = count;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&mutex);
+      };
+      for(int lane = 0; lane < numlane; lane++)
+        worker[lane]->post([&, lane] {
+          for(int step = 0; step < command[lane].size(); step++) {
+            Command<T, A> &c = *command[lane][step];
+            // WAIT FOR DEPENDENCIES ONLY
+            pthread_mutex_lock(&mutex);
+            while(!ready(c.depend, completed, step) || !in_order(lane, step, command, started))
+              pthread_cond_wait(&cond, &mutex);
+            if(c.idle()) {
+              started[lane] = arrived[lane] = completed[lane] = step + 1;
+              pthread_cond_broadcast(&cond);
+              pthread_mutex_unlock(&mutex);
+              continue;
+            }
+            pthread_mutex_unlock(&mutex);
+            c.comm->start();
+            if(c.compress)
+              c.compress->start();
+            update(started, lane, step + 1);
+            auto compute = [&] () {
+              pthread_mutex_lock(&mutex);
+              while(!ready(c.depend_compute, arrived, step + 1))
+                pthread_cond_wait(&cond, &mutex);
+              pthread_mutex_unlock(&mutex);
+              c.compute->start();
+            };
+            // A COMPUTATION THAT DOES NOT WAIT FOR ITS OWN LANE STARTS BEFORE THE ARRIVAL
+            bool overlap = !(c.depend_compute & (1u << lane));
+            if(overlap)
+              compute();
+            c.comm->wait();
+            if(c.compress)
+              c.compress->wait();
+            update(arrived, lane, step + 1);
+            if(!overlap)
+              compute();
+            c.compute->wait();
+            update(completed, lane, step + 1);
+          }
+        });
+      for(int lane = 0; lane < numlane; lane++)
+        worker[lane]->wait();
+      pthread_mutex_destroy(&mutex);
+      pthread_cond_destroy(&cond);
     }
 
-    static void* run_async(void* arg) {
-      CommBench::setup_gpu();
-      Comm<T> *test = (Comm<T>*) arg;
-      test->run();
-      pthread_exit(NULL);
+    // ENDPOINT REBINDING
+    bool endpoint(T *ptr) {
+      return (this->sendbuf != nullptr && ptr >= this->sendbuf && ptr < this->sendbuf + sendcount) || (this->recvbuf != nullptr && ptr >= this->recvbuf && ptr < this->recvbuf + recvcount);
+    }
+    T* rebase(T *ptr, T *sendbuf, T *recvbuf) {
+      if(this->sendbuf != nullptr && ptr >= this->sendbuf && ptr < this->sendbuf + sendcount)
+        return sendbuf + (ptr - this->sendbuf);
+      if(this->recvbuf != nullptr && ptr >= this->recvbuf && ptr < this->recvbuf + recvcount)
+        return recvbuf + (ptr - this->recvbuf);
+      return ptr;
     }
 
-    pthread_t thread;
-    void start() {
-      pthread_create(&thread, NULL, Comm<T>::run_async, this);
+    void find_endpoints() {
+      // MARK STEPS THAT TOUCH THE ENDPOINTS OF ANY PROCESS
+      std::vector<int> flag;
+      for(auto &list : coll_pipeline)
+        for(auto &coll : list) {
+          int touch = 0;
+          for(int i = 0; i < coll->numcomm; i++) {
+            if(coll->sendid[i] == myid && endpoint(coll->sendbuf[i]))
+              touch |= 1;
+            if(coll->recvid[i] == myid && endpoint(coll->recvbuf[i]))
+              touch |= 1;
+          }
+          for(int i = 0; i < coll->numcompute; i++)
+            if(coll->compid[i] == myid) {
+              for(auto &input : coll->inputbuf[i])
+                if(endpoint(input))
+                  touch |= 2;
+              if(endpoint(coll->outputbuf[i]))
+                touch |= 2;
+            }
+          flag.push_back(touch);
+        }
+      MPI_Allreduce(MPI_IN_PLACE, flag.data(), flag.size(), MPI_INT, MPI_BOR, comm_plan);
+      int step = 0;
+      for(auto &list : coll_pipeline) {
+        endpoint_step.push_back(std::vector<int>(flag.begin() + step, flag.begin() + step + list.size()));
+        step += list.size();
+      }
     }
+
+    // REBIND ENDPOINTS TO USER BUFFERS (CALLED WITH bind_mutex LOCKED)
+    // Only the commands that touch the endpoints are rebuilt, once per distinct set of user buffers; intermediate buffers stay fixed.
+    // The first call with a pair of user buffers builds new communicators for these commands, which exchanges memory handles
+    // (IPC) and may set up library state, as much as the same commands take at init (collective on the plan). Later calls with
+    // the same pair find the pipeline locally, without communication: every process must call with a bound pair or with a new
+    // pair at the same time, as when all processes allocate and reuse their buffers in the same order. Builds are counted by
+    // bound_generation, which all processes check at each build. At most numbound pipelines are kept: the least recently used
+    // one is released (after its requests complete) to bind a new pair, the same one on all processes since the uses are the same.
+    std::vector<std::list<Command<T, A>>> &rebind(T *sendbuf, T *recvbuf) {
+      if((sendbuf == recvbuf) != (this->sendbuf == this->recvbuf))
+        drain(this); // the staging below writes into buffers of requests in flight
+      if(sendbuf == recvbuf && this->sendbuf != this->recvbuf) {
+        // IN-PLACE CALL OF AN OUT-OF-PLACE PLAN: STAGE THE INPUT, BIND THE OUTPUT
+        CommBench::memcpyD2D(this->sendbuf, sendbuf, sendcount);
+        sendbuf = this->sendbuf;
+      }
+      else if(sendbuf != recvbuf && this->sendbuf == this->recvbuf) {
+        // OUT-OF-PLACE CALL OF AN IN-PLACE PLAN: MOVE THE INPUT INTO THE OUTPUT, BIND THE OUTPUT
+        CommBench::memcpyD2D(recvbuf, sendbuf, sendcount);
+        sendbuf = recvbuf;
+      }
+      // BOUND PIPELINE (ALL PROCESSES FIND THEIRS)
+      if(sendbuf == this->sendbuf && recvbuf == this->recvbuf)
+        return command_batch;
+      {
+        auto it = bound_id.find(std::make_pair(sendbuf, recvbuf));
+        if(it != bound_id.end()) {
+          bound_use[it->second - 1] = ++bound_clock;
+          return command_bound[it->second - 1];
+        }
+      }
+      // NEW PAIR (ALL PROCESSES BUILD)
+      {
+        long generation[2] = {(long) bound_generation, -(long) bound_generation};
+        MPI_Allreduce(MPI_IN_PLACE, generation, 2, MPI_LONG, MPI_MAX, comm_plan);
+        if(generation[0] != -generation[1] && myid == printid)
+          printf("ERROR!!! rebind: a pair of user buffers is new on some processes and bound on others!\n");
+        bound_generation++;
+      }
+      // REBUILD COMMANDS THAT TOUCH THE ENDPOINTS
+      if(endpoint_step.size() != coll_pipeline.size())
+        find_endpoints();
+      int printid_temp = CommBench::printid;
+      CommBench::printid = -1;
+      std::vector<std::list<Command<T, A>>> pipeline(command_batch.size());
+      for(int lane = 0; lane < command_batch.size(); lane++) {
+        auto command = command_batch[lane].begin();
+        int step = 0;
+        for(auto &coll : coll_pipeline[lane]) {
+          CommBench::Comm<T> *comm = command->comm;
+          Compute<T, A> *compute = command->compute;
+          Compress<T> *compress = command->compress;
+          if(endpoint_step[lane][step] & 1) {
+            comm = new CommBench::Comm<T>(coll->lib);
+            compress = (command->compress ? new Compress<T>() : nullptr);
+            if(compress) {
+              compress->tag = command->compress->tag;
+              compress->comm = command->compress->comm;
+            }
+            int send = 0;
+            int recv = 0;
+            for(int i = 0; i < coll->numcomm; i++)
+              if(coll->codec[i] == raw)
+                comm->add(rebase(coll->sendbuf[i], sendbuf, recvbuf), coll->sendoffset[i], rebase(coll->recvbuf[i], sendbuf, recvbuf), coll->recvoffset[i], coll->count[i], coll->sendid[i], coll->recvid[i]);
+              else {
+                int level = (coll->sendid[i] == myid ? command->compress->sendlevel[send++] : (coll->recvid[i] == myid ? command->compress->recvlevel[recv++] : 0));
+                compress->add(rebase(coll->sendbuf[i], sendbuf, recvbuf), coll->sendoffset[i], rebase(coll->recvbuf[i], sendbuf, recvbuf), coll->recvoffset[i], coll->count[i], coll->sendid[i], coll->recvid[i], level, coll->codec[i]);
+              }
+            if(compress)
+              compress->share(*command->compress); // one residual per transfer for all user buffers
+          }
+          if(endpoint_step[lane][step] & 2) {
+            compute = new Compute<T, A>();
+            for(int i = 0; i < coll->numcompute; i++) {
+              std::vector<T*> inputbuf;
+              for(auto &input : coll->inputbuf[i])
+                inputbuf.push_back(coll->compid[i] == myid ? rebase(input, sendbuf, recvbuf) : input);
+              compute->add(inputbuf, coll->compid[i] == myid ? rebase(coll->outputbuf[i], sendbuf, recvbuf) : coll->outputbuf[i], coll->numreduce[i], coll->compid[i]);
+            }
+            compute->fuse(*command->compute);
+          }
+          pipeline[lane].push_back(Command<T, A>(comm, compute, compress));
+          pipeline[lane].back().depend = command->depend;
+          pipeline[lane].back().depend_compute = command->depend_compute;
+          command++;
+          step++;
+        }
+      }
+      CommBench::printid = printid_temp;
+      // THE SAME SLOT ON ALL PROCESSES: THE USES ARE AGREED
+      int slot = command_bound.size();
+      if(slot < numbound) {
+        command_bound.push_back(pipeline);
+        bound_key.push_back(std::make_pair(sendbuf, recvbuf));
+        bound_use.push_back(0);
+      }
+      else {
+        slot = std::min_element(bound_use.begin(), bound_use.end()) - bound_use.begin();
+        drain(this); // requests in flight may run on the released pipeline
+        release(command_bound[slot], command_batch);
+        auto it = bound_id.find(bound_key[slot]);
+        if(it != bound_id.end() && it->second == slot + 1)
+          bound_id.erase(it);
+        command_bound[slot] = pipeline;
+        bound_key[slot] = std::make_pair(sendbuf, recvbuf);
+      }
+      bound_use[slot] = ++bound_clock;
+      bound_id[std::make_pair(sendbuf, recvbuf)] = slot + 1;
+      if(myid == printid)
+        printf("rebind endpoints: pipeline %d of %d\n", slot + 1, numbound);
+      return command_bound[slot];
+    }
+
+    // RELEASE THE COMMANDS OF A BOUND PIPELINE THAT ARE NOT SHARED WITH ITS command_batch
+    void release(std::vector<std::list<Command<T, A>>> &pipeline, std::vector<std::list<Command<T, A>>> &command_batch) {
+      for(int lane = 0; lane < pipeline.size(); lane++) {
+        auto command = command_batch[lane].begin();
+        for(auto &bound : pipeline[lane]) {
+          if(bound.comm != command->comm)
+            delete bound.comm;
+          if(bound.compress != command->compress)
+            delete bound.compress;
+          if(bound.compute != command->compute)
+            delete bound.compute;
+          command++;
+        }
+      }
+    }
+    // RELEASE THE PIPELINES OF A COUNT
+    void release(INSTANCE &instance) {
+      for(auto &pipeline : instance.command_bound)
+        release(pipeline, instance.command_batch);
+      for(auto &list : instance.command_batch)
+        for(auto &command : list) {
+          delete command.comm;
+          delete command.compute;
+          delete command.compress;
+        }
+      for(auto &list : instance.coll_pipeline)
+        for(auto &coll : list)
+          delete coll;
+    }
+
+    // NONBLOCKING EXECUTION (COLLECTIVE), SEE request.h
+    MPI_Comm comm_plan = MPI_COMM_NULL; // own communicator: compressed messages, rebinding and tickets of the plan
+    unsigned long order = 0; // of initialization
+    pthread_mutex_t bind_mutex = PTHREAD_MUTEX_INITIALIZER; // collectives on comm_plan and the bound pipelines
+    std::vector<std::pair<int, int>> pairs; // of raw transfers, which share the communicator of CommBench with other plans
+    static void run_request(Request *request) {
+      Comm<T, A> *comm = (Comm<T, A>*) request->plan;
+      comm->run(*(std::vector<std::list<Command<T, A>>>*) request->pipeline);
+    }
+    void isolate() {
+      if(comm_plan == MPI_COMM_NULL) {
+        MPI_Comm_dup(comm_mpi, &comm_plan);
+        order = request_order++;
+      }
+      for(auto &list : command_batch)
+        for(auto &command : list)
+          if(command.compress)
+            command.compress->comm = comm_plan;
+    }
+    void find_pairs() {
+      std::set<std::pair<int, int>> found;
+      for(auto &list : coll_pipeline)
+        for(auto &coll : list)
+          for(int i = 0; i < coll->numcomm; i++)
+            if(coll->sendid[i] != coll->recvid[i] && coll->codec[i] == raw)
+              found.insert(std::make_pair(std::min(coll->sendid[i], coll->recvid[i]), std::max(coll->sendid[i], coll->recvid[i])));
+      pairs.assign(found.begin(), found.end());
+    }
+    // PLANS THAT MAY CONFLICT WITH OTHERS RESERVE AND AGREE ON THE TICKET (CALLED WITH bind_mutex LOCKED)
+    Pending* reserve_ticket() {
+      return (pairs.size() || thread_level() < MPI_THREAD_MULTIPLE ? reserve(this, &pairs) : nullptr);
+    }
+    Request* start() {
+      pthread_mutex_lock(&bind_mutex);
+      Pending *pending = reserve_ticket();
+      unsigned long ticket = (pending ? agree(comm_plan, pending) : 0);
+      Request *request = issue(this, order, &pairs, run_request, &command_batch, ticket, pending);
+      pthread_mutex_unlock(&bind_mutex);
+      return request;
+    }
+    Request* start(T *sendbuf, T *recvbuf) {
+      pthread_mutex_lock(&bind_mutex);
+      std::vector<std::list<Command<T, A>>> &pipeline = rebind(sendbuf, recvbuf);
+      Pending *pending = reserve_ticket();
+      unsigned long ticket = (pending ? agree(comm_plan, pending) : 0);
+      Request *request = issue(this, order, &pairs, run_request, &pipeline, ticket, pending);
+      pthread_mutex_unlock(&bind_mutex);
+      return request;
+    }
+    // COMPLETES AND RELEASES ALL REQUESTS OF THE PLAN (DO NOT WAIT FOR THEM AGAIN)
     void wait() {
-      pthread_join(thread, NULL);
+      wait_plan(this);
+    }
+
+    // BYTES RECEIVED AND REDUCED PER PROCESS WITH THE REDUCERS AND FORWARDERS BY LOCAL INDEX (before) AND BALANCED (after)
+    void report_load(const std::vector<size_t> &before, const std::vector<size_t> &after) {
+      if(myid == printid) {
+        printf("load per process (bytes received and reduced), by local index -> balanced:\n");
+        if(numproc < 64)
+          for(int p = 0; p < numproc; p++) {
+            printf("  %d: ", p);
+            CommBench::print_data(before[p]);
+            printf(" -> ");
+            CommBench::print_data(after[p]);
+            printf("\n");
+          }
+        size_t total[2] = {0, 0};
+        for(int p = 0; p < numproc; p++) {
+          total[0] += before[p];
+          total[1] += after[p];
+        }
+        printf("max ");
+        CommBench::print_data(*std::max_element(before.begin(), before.end()));
+        printf(" -> ");
+        CommBench::print_data(*std::max_element(after.begin(), after.end()));
+        printf(" mean ");
+        CommBench::print_data(total[0] / numproc);
+        printf(" -> ");
+        CommBench::print_data(total[1] / numproc);
+        printf("\n");
+      }
+    }
+
+    // REPORT COMPRESSION RATIO AND EFFECTIVE BANDWIDTH PER LEVEL (ACCUMULATED OVER ALL CALLS)
+    void report_compression() {
+      int numlevel = hierarchy.size();
+      std::vector<double> rawbytes(numlevel, 0);
+      std::vector<double> zipbytes(numlevel, 0);
+      std::vector<double> ziptime(numlevel, 0);
+      std::vector<std::vector<std::list<Command<T, A>>>*> pipelines = {&command_batch};
+      for(auto &pipeline : command_bound)
+        pipelines.push_back(&pipeline);
+      for(auto &pipeline : pipelines)
+        for(auto &list : *pipeline)
+          for(auto &command : list)
+            if(command.compress)
+              for(int level = 0; level < command.compress->rawbytes.size() && level < numlevel; level++) {
+                rawbytes[level] += command.compress->rawbytes[level];
+                zipbytes[level] += command.compress->zipbytes[level];
+                ziptime[level] += command.compress->ziptime[level];
+              }
+      MPI_Allreduce(MPI_IN_PLACE, rawbytes.data(), numlevel, MPI_DOUBLE, MPI_SUM, comm_mpi);
+      MPI_Allreduce(MPI_IN_PLACE, zipbytes.data(), numlevel, MPI_DOUBLE, MPI_SUM, comm_mpi);
+      MPI_Allreduce(MPI_IN_PLACE, ziptime.data(), numlevel, MPI_DOUBLE, MPI_MAX, comm_mpi);
+      if(myid == printid) {
+        printf("**************** HiCCL COMPRESSION\n");
+        for(int level = 0; level < numlevel; level++)
+          if(rawbytes[level] > 0) {
+            printf("level %d raw ", level);
+            CommBench::print_data(rawbytes[level]);
+            printf(" compressed ");
+            CommBench::print_data(zipbytes[level]);
+            printf(" ratio %.2f time %.4e s effective bandwidth %.4e GB/s\n", rawbytes[level] / zipbytes[level], ziptime[level], rawbytes[level] / ziptime[level] / 1e9);
+          }
+        printf("*********************************\n");
+      }
     }
 
     void measure(int warmup, int numiter, size_t count) {
@@ -234,7 +1380,7 @@
       }
       MPI_Barrier(comm_mpi);
       {
-        using Iter = typename std::list<Command<T>>::iterator;
+        using Iter = typename std::list<Command<T, A>>::iterator;
         std::vector<Iter> commandptr(command_batch.size());
         for(int i = 0; i < command_batch.size(); i++)
           commandptr[i] = command_batch[i].begin();
@@ -270,6 +1416,97 @@
       }
     }
 
+    // PLANNER BENCHMARK: TIME OF plan() FOR EACH NUMBER OF THREADS (SLOWEST PROCESS, MEDIAN OF numiter) WITHOUT ALLOCATING
+    // BUFFERS, AND THE RESIDENT MEMORY THE PLAN TAKES (LARGEST PROCESS, MEASURED); THE PLANS ARE DISCARDED
+    // The planner with lists of ranks is not kept: collectives/compare_planner.sh builds a planner workload against an earlier
+    // version and this one. Ranks against runs of the primitives is only an estimate of what the rank sets save.
+    void measure_plan(int numiter, std::vector<int> numthread = std::vector<int> {1}) {
+      if(loadfile.size() || numiter < 1) {
+        if(myid == printid)
+          printf("nothing to measure (schedule loaded from a file or no iterations)!\n");
+        return;
+      }
+      {
+        size_t numprim = 0;
+        size_t numrank = 0;
+        size_t numrun = 0;
+        auto add = [&] (const Ranks &ranks) {
+          numprim++;
+          numrank += ranks.size();
+          numrun += ranks.runs();
+        };
+        for(int epoch = 0; epoch < numepoch; epoch++) {
+          for(auto &bcast : bcast_epoch[epoch])
+            add(bcast.recvids);
+          for(auto &reduce : reduce_epoch[epoch])
+            add(reduce.sendids);
+        }
+        if(myid == printid)
+          printf("planner benchmark: %zu primitives in %d epochs, %zu ranks in %zu runs (estimate of the saving over lists)\n", numprim, numepoch, numrank, numrun);
+      }
+      int numthread_temp = this->numthread;
+      std::vector<int> passes_temp;
+      std::string dumpfile_temp;
+      std::vector<std::pair<void*, size_t>> buffers_temp;
+      std::vector<std::list<Coll<T>*>> coll_batch_temp;
+      std::vector<int> batchoffset_temp;
+      std::swap(passes, passes_temp);
+      std::swap(dumpfile, dumpfile_temp);
+      std::swap(buffers, buffers_temp);
+      std::swap(coll_batch, coll_batch_temp);
+      std::swap(batchoffset, batchoffset_temp);
+      size_t reuse_temp = reuse;
+      size_t recycle_temp = recycle;
+      int printid_temp = printid;
+      printid = -1;
+      buffer_dry = true;
+      for(auto &n : numthread) {
+        this->numthread = std::max(n, 1);
+        std::vector<double> times(numiter);
+        size_t numcoll = 0;
+        size_t numcomm = 0;
+        long resident = 0; // taken by the plan (largest over the iterations)
+        for(int iter = 0; iter < numiter; iter++) {
+          long resident_before = resident_bytes();
+          MPI_Barrier(comm_mpi);
+          double time = MPI_Wtime();
+          plan();
+          time = MPI_Wtime() - time;
+          resident = std::max(resident, (long) resident_bytes() - resident_before);
+          MPI_Allreduce(MPI_IN_PLACE, &time, 1, MPI_DOUBLE, MPI_MAX, comm_mpi);
+          times[iter] = time;
+          numcoll = 0;
+          numcomm = 0;
+          for(auto &coll_list : coll_batch)
+            for(auto &coll : coll_list) {
+              numcoll++;
+              numcomm += coll->numcomm;
+              delete coll;
+            }
+          coll_batch.clear();
+          batchoffset.clear();
+          buffers.clear();
+        }
+        std::sort(times.begin(), times.end());
+        MPI_Allreduce(MPI_IN_PLACE, &resident, 1, MPI_LONG, MPI_MAX, comm_mpi);
+        if(myid == printid_temp) {
+          printf("planner threads %d: median %.4e s min %.4e s max %.4e s (%zu steps, %zu transfers) resident ", this->numthread, times[numiter / 2], times[0], times[numiter - 1], numcoll, numcomm);
+          CommBench::print_data(resident);
+          printf("\n");
+        }
+      }
+      buffer_dry = false;
+      printid = printid_temp;
+      reuse = reuse_temp;
+      recycle = recycle_temp;
+      this->numthread = numthread_temp;
+      std::swap(passes, passes_temp);
+      std::swap(dumpfile, dumpfile_temp);
+      std::swap(buffers, buffers_temp);
+      std::swap(coll_batch, coll_batch_temp);
+      std::swap(batchoffset, batchoffset_temp);
+    }
+
     void report() {
       if(myid == printid) {
         printf("command_batch size %zu\n", command_batch.size());
@@ -293,7 +1530,7 @@
       }
       int print_batch_size = (command_batch.size() > 16 ? 16 : command_batch.size());
       {
-        using Iter = typename std::list<Command<T>>::iterator;
+        using Iter = typename std::list<Command<T, A>>::iterator;
         std::vector<Iter> commandptr(print_batch_size);
         for(int i = 0; i < print_batch_size; i++)
           commandptr[i] = command_batch[i].begin();
@@ -361,7 +1598,7 @@
         }
       }
 
-      using Iter = typename std::list<Command<T>>::iterator;
+      using Iter = typename std::list<Command<T, A>>::iterator;
       std::vector<Iter> commandptr(command_batch.size());
       for(int i = 0; i < command_batch.size(); i++)
         commandptr[i] = command_batch[i].begin();
@@ -1,18 +1,30 @@
 
-  template <typename T>
+  template <typename T, typename A = typename accumulator<T>::type>
   class Command {
 
     public:
 
     CommBench::Comm<T> *comm = nullptr;
-    Compute<T> *compute = nullptr;
+    Compute<T, A> *compute = nullptr;
+    Compress<T> *compress = nullptr;
+    // DEPENDENCIES ACROSS LANES (BIT PER LANE), FOLLOWING THE BATCHES MERGED INTO THIS STEP
+    unsigned depend = 0; // lanes whose previous step must complete before this step starts
+    unsigned depend_compute = 0; // lanes whose communication of this step must complete before this computation starts
+                                 // (without its own lane, the computation overlaps the communication of its lane)
 
     // COMMUNICATION
     // Command(CommBench::Comm<T> *comm) : comm(comm) {}
     // COMPUTATION
-    // Command(HiCCL::Compute<T> *compute) : compute(compute) {}
+    // Command(HiCCL::Compute<T, A> *compute) : compute(compute) {}
     // COMMUNICATION + COMPUTATION
-    Command(CommBench::Comm<T> *comm, Compute<T> *compute) : comm(comm), compute(compute) {}
+    Command(CommBench::Comm<T> *comm, Compute<T, A> *compute) : comm(comm), compute(compute) {}
+    // COMMUNICATION (SOME COMPRESSED) + COMPUTATION
+    Command(CommBench::Comm<T> *comm, Compute<T, A> *compute, Compress<T> *compress) : comm(comm), compute(compute), compress(compress) {}
+
+    // NO TRANSFERS OR COMPUTATIONS ON THIS PROCESS (e.g., LOCAL MATERIALIZATION): run() SKIPS THE STEP
+    bool idle() const {
+      return comm->numsend + comm->numrecv == 0 && compress == nullptr && compute->numcomp == 0;
+    }
 
     void measure(int warmup, int numiter, size_t count) {
       int numcomm = 0;
@@ -37,8 +49,8 @@
     }
   };
 
-  template <typename T>
-  void implement(std::vector<std::list<Coll<T>*>> &coll_batch, std::vector<std::list<Command<T>>> &pipeline, int pipeoffset) {
+  template <typename T, typename A>
+  void implement(std::vector<std::list<Coll<T>*>> &coll_batch, std::vector<std::list<Command<T, A>>> &pipeline, std::vector<std::list<Coll<T>*>> &coll_pipeline, std::vector<int> &batchoffset, std::vector<size_t> &threshold, std::vector<CommBench::library> &lib_small, std::vector<CommBench::library> &lib_large, std::vector<int> &codec, std::vector<int> &codec_reduce, bool feedback, const Cost *cost = nullptr) {
 
     for(auto &coll : coll_batch[0])
       coll->report();
@@ -64,9 +76,12 @@
       std::vector<size_t> buffsize_all(numproc);
       std::vector<size_t> recycle_all(numproc);
       std::vector<size_t> reuse_all(numproc);
-      MPI_Allgather(&buffsize, sizeof(size_t), MPI_BYTE, buffsize_all.data(), sizeof(size_t), MPI_BYTE, comm_mpi);
-      MPI_Allgather(&recycle, sizeof(size_t), MPI_BYTE, recycle_all.data(), sizeof(size_t), MPI_BYTE, comm_mpi);
-      MPI_Allgather(&reuse, sizeof(size_t), MPI_BYTE, reuse_all.data(), sizeof(size_t), MPI_BYTE, comm_mpi);
+      size_t buffsize_my = buffsize;
+      size_t recycle_my = recycle;
+      size_t reuse_my = reuse;
+      MPI_Allgather(&buffsize_my, sizeof(size_t), MPI_BYTE, buffsize_all.data(), sizeof(size_t), MPI_BYTE, comm_mpi);
+      MPI_Allgather(&recycle_my, sizeof(size_t), MPI_BYTE, recycle_all.data(), sizeof(size_t), MPI_BYTE, comm_mpi);
+      MPI_Allgather(&reuse_my, sizeof(size_t), MPI_BYTE, reuse_all.data(), sizeof(size_t), MPI_BYTE, comm_mpi);
       if(myid == printid) {
         for(int p = 0; p < numproc; p++)
           printf("HiCCL Memory [%d]: %zu bytes (%.2f GB) - %.2f GB reused - %.2f GB recycled\n", p, buffsize_all[p] * sizeof(T), buffsize_all[p] * sizeof(T) / 1.e9, reuse_all[p] * sizeof(T) / 1.e9, recycle_all[p] * sizeof(T) / 1.e9);
@@ -77,27 +92,134 @@
       }
     }
 
-    std::vector<std::list<Coll<T>*>> coll_pipeline;
     std::vector<Coll<T>*> coll_mixed;
 
+    // LIBRARIES OF THE TRANSFERS AND COMPUTATION OF EACH STEP ON ALL PROCESSES (ONE REDUCTION WHEN MATERIALIZED LOCALLY)
+    bool local = false;
+    {
+      std::vector<unsigned> usage;
+      for(auto &list : coll_batch)
+        for(auto &coll : list) {
+          coll->usage = (coll->numcompute ? 1u << CommBench::numlib : 0);
+          for(int j = 0; j < coll->numcomm; j++)
+            coll->usage |= 1u << coll->select(coll->count[j], threshold, lib_small, lib_large);
+          usage.push_back(coll->usage);
+          local |= coll->local;
+        }
+      if(local) {
+        MPI_Allreduce(MPI_IN_PLACE, usage.data(), usage.size(), MPI_UNSIGNED, MPI_BOR, comm_mpi);
+        int k = 0;
+        for(auto &list : coll_batch)
+          for(auto &coll : list)
+            coll->usage = usage[k++];
+      }
+    }
+    const unsigned usage_comm = (1u << CommBench::numlib) - 1;
+
     std::vector<int> lib;
     std::vector<int> lib_hash(CommBench::numlib);
     {
       for(int i = 0; i < coll_batch.size(); i++) {
-        for(auto &coll : coll_batch[i])
-          lib_hash[coll->lib]++;
-        for(int j = 0; j < i * pipeoffset; j++)
-          coll_batch[i].push_front(new Coll<T>(CommBench::dummy));
+        for(auto &coll : coll_batch[i]) {
+          for(int j = 0; j < CommBench::numlib; j++)
+            if(coll->usage & (1u << j))
+              lib_hash[j]++;
+          if((coll->usage & usage_comm) == 0)
+            lib_hash[coll->lib]++;
+        }
       }
       for(int i = 0; i < CommBench::numlib; i++)
         if(lib_hash[i]) {
           lib_hash[i] = lib.size();
           lib.push_back(i);
-          pipeline.push_back(std::list<Command<T>>());
+          pipeline.push_back(std::list<Command<T, A>>());
           coll_pipeline.push_back(std::list<Coll<T>*>());
         }
     }
 
+    // LANES OF THE TRANSFERS OF A STEP, COMPUTATION GOES TO THE LOWEST OF THEM, SINCE run() WAITS LANES IN REVERSE ORDER
+    auto lanes = [&] (Coll<T> *coll, unsigned &lanes_comm, int &lane_compute) {
+      lanes_comm = 0;
+      lane_compute = -1;
+      for(int j = CommBench::numlib - 1; j > -1; j--)
+        if(coll->usage & (1u << j)) {
+          lanes_comm |= 1u << lib_hash[j];
+          lane_compute = lib_hash[j];
+        }
+      if(lane_compute == -1)
+        lane_compute = lib_hash[coll->lib];
+    };
+
+    // PLACE THE STEPS OF THE BATCHES: STAGGERED BY batchoffset, OR BY COST (makespan.h)
+    std::vector<std::vector<int>> rows(coll_batch.size());
+    for(int i = 0; i < coll_batch.size(); i++)
+      for(int k = 0; k < coll_batch[i].size(); k++)
+        rows[i].push_back(batchoffset[i] + k);
+    if(cost) {
+      Makespan<T> staggered(*cost, lib);
+      Makespan<T> scheduled(*cost, lib);
+      std::vector<std::vector<typename Makespan<T>::Load>> step(coll_batch.size());
+      for(int i = 0; i < coll_batch.size(); i++)
+        for(auto &coll : coll_batch[i]) {
+          unsigned lanes_comm;
+          int lane_compute;
+          lanes(coll, lanes_comm, lane_compute);
+          std::vector<int> lane_comm(coll->numcomm);
+          for(int j = 0; j < coll->numcomm; j++)
+            lane_comm[j] = lib_hash[coll->select(coll->count[j], threshold, lib_small, lib_large)];
+          step[i].push_back(scheduled.load(coll, lane_comm, lane_compute));
+        }
+      // LOCAL: A PROCESS KNOWS ITS OWN LOAD ONLY, THE HEAVIEST PROCESS OF EACH LANE STANDS FOR ALL (AN UPPER BOUND)
+      if(local) {
+        std::vector<double> heaviest;
+        for(auto &list : step)
+          for(auto &load : list)
+            for(int lane = 0; lane < lib.size(); lane++)
+              heaviest.push_back(load.time[lane].count(myid) ? load.time[lane][myid] : 0);
+        MPI_Allreduce(MPI_IN_PLACE, heaviest.data(), heaviest.size(), MPI_DOUBLE, MPI_MAX, comm_mpi);
+        int k = 0;
+        for(int i = 0; i < coll_batch.size(); i++) {
+          auto load = step[i].begin();
+          for(auto &coll : coll_batch[i]) {
+            unsigned lanes_comm;
+            int lane_compute;
+            lanes(coll, lanes_comm, lane_compute);
+            for(int lane = 0; lane < lib.size(); lane++) {
+              load->busy[lane] = (lanes_comm & (1u << lane)) || ((coll->usage >> CommBench::numlib) && lane == lane_compute);
+              load->time[lane].clear();
+              if(load->busy[lane])
+                load->time[lane][0] = heaviest[k];
+              k++;
+            }
+            load++;
+          }
+        }
+      }
+      std::vector<std::vector<int>> rows_scheduled(coll_batch.size());
+      for(int i = 0; i < coll_batch.size(); i++) {
+        staggered.place(step[i], rows[i]);
+        rows_scheduled[i] = scheduled.place(step[i]);
+      }
+      bool better = scheduled.total() < staggered.total();
+      if(better)
+        rows = rows_scheduled;
+      if(myid == printid)
+        printf("makespan scheduler: estimated makespan %e -> %e seconds, bubble fraction %.3f -> %.3f, %d -> %d steps%s\n",
+               staggered.total(), scheduled.total(), staggered.bubble(), scheduled.bubble(), staggered.numrow(), scheduled.numrow(), better ? "" : " (keeping staggered)");
+    }
+    // PAD WITH EMPTY STEPS UP TO THE ROWS
+    for(int i = 0; i < coll_batch.size(); i++) {
+      std::list<Coll<T>*> padded;
+      int k = 0;
+      for(auto &coll : coll_batch[i]) {
+        while(padded.size() < rows[i][k])
+          padded.push_back(new Coll<T>(CommBench::dummy));
+        padded.push_back(coll);
+        k++;
+      }
+      coll_batch[i].swap(padded);
+    }
+
     // REPORT DEGENERATE PIPELINE
     report_pipeline(coll_batch);
 
@@ -106,6 +228,10 @@
       std::vector<Iter> coll_ptr(coll_batch.size());
       for(int i = 0; i < coll_batch.size(); i++)
         coll_ptr[i] = coll_batch[i].begin();
+      std::vector<unsigned> lane_prev(coll_batch.size(), 0); // lanes of the previous step of each batch
+      int printid_temp = CommBench::printid;
+      if(local)
+        CommBench::printid = -1; // reports of additions would need all processes
       while(true) {
         bool finished = true;
         for(int i = 0; i < coll_batch.size(); i++)
@@ -114,33 +240,72 @@
         if(finished)
           break;
         Coll<T> *coll_total = new Coll<T>(CommBench::dummy);
+        coll_total->local = local;
+        bool busy = false;
         std::vector<Coll<T>*> coll_temp(lib.size());
         std::vector<CommBench::Comm<T>*> comm_temp(lib.size());
-        std::vector<Compute<T>*> compute_temp(lib.size());
+        std::vector<Compute<T, A>*> compute_temp(lib.size());
+        std::vector<Compress<T>*> compress_temp(lib.size(), nullptr);
+        std::vector<unsigned> depend(lib.size(), 0);
+        std::vector<unsigned> depend_compute(lib.size(), 0);
         for(int i = 0; i < lib.size(); i++) {
           coll_temp[i] = new Coll<T>((CommBench::library) lib[i]);
+          coll_temp[i]->local = local;
           comm_temp[i] = new CommBench::Comm<T>((CommBench::library) lib[i]);
-          compute_temp[i] = new Compute<T>();
+          compute_temp[i] = new Compute<T, A>();
         }
         for(int i = 0; i < coll_batch.size(); i++)
           if(coll_ptr[i] != coll_batch[i].end()) {
             Coll<T> *coll = *coll_ptr[i];
             coll_ptr[i]++;
+            unsigned lanes_comm;
+            int lane_compute;
+            lanes(coll, lanes_comm, lane_compute);
+            busy |= (coll->usage != 0);
             for(int i = 0; i < coll->numcomm; i++) {
+              int lane = lib_hash[coll->select(coll->count[i], threshold, lib_small, lib_large)];
               coll_total->add(coll->sendbuf[i], coll->sendoffset[i], coll->recvbuf[i], coll->recvoffset[i], coll->count[i], coll->sendid[i], coll->recvid[i]);
-              coll_temp[lib_hash[coll->lib]]->add(coll->sendbuf[i], coll->sendoffset[i], coll->recvbuf[i], coll->recvoffset[i], coll->count[i], coll->sendid[i], coll->recvid[i]);
-              comm_temp[lib_hash[coll->lib]]->add(coll->sendbuf[i], coll->sendoffset[i], coll->recvbuf[i], coll->recvoffset[i], coll->count[i], coll->sendid[i], coll->recvid[i]);
+              // COMPRESS TRANSFERS ACROSS PROCESSES ON CHOSEN LEVELS
+              int code = (coll->level > -1 && coll->level < codec.size() && coll->sendid[i] != coll->recvid[i] ? codec[coll->level] : raw);
+              // QUANTIZE PARTIAL SUMS ON CHOSEN LEVELS
+              if(coll->reduction && coll->level > -1 && coll->level < codec_reduce.size() && coll->sendid[i] != coll->recvid[i] && codec_reduce[coll->level] != raw)
+                code = codec_reduce[coll->level];
+              coll_temp[lane]->add(coll->sendbuf[i], coll->sendoffset[i], coll->recvbuf[i], coll->recvoffset[i], coll->count[i], coll->sendid[i], coll->recvid[i], code);
+              if(code == raw)
+                comm_temp[lane]->add(coll->sendbuf[i], coll->sendoffset[i], coll->recvbuf[i], coll->recvoffset[i], coll->count[i], coll->sendid[i], coll->recvid[i]);
+              else {
+                if(compress_temp[lane] == nullptr) {
+                  compress_temp[lane] = new Compress<T>();
+                  compress_temp[lane]->feedback = feedback;
+                  compress_temp[lane]->tag = lane;
+                }
+                compress_temp[lane]->add(coll->sendbuf[i], coll->sendoffset[i], coll->recvbuf[i], coll->recvoffset[i], coll->count[i], coll->sendid[i], coll->recvid[i], coll->level, code);
+              }
             }
             for(int i = 0; i < coll->numcompute; i++) {
               coll_total->add(coll->inputbuf[i], coll->outputbuf[i], coll->numreduce[i], coll->compid[i]);
-              coll_temp[lib_hash[coll->lib]]->add(coll->inputbuf[i], coll->outputbuf[i], coll->numreduce[i], coll->compid[i]);
-              compute_temp[lib_hash[coll->lib]]->add(coll->inputbuf[i], coll->outputbuf[i], coll->numreduce[i], coll->compid[i]);
+              coll_temp[lane_compute]->add(coll->inputbuf[i], coll->outputbuf[i], coll->numreduce[i], coll->compid[i]);
+              compute_temp[lane_compute]->add(coll->inputbuf[i], coll->outputbuf[i], coll->numreduce[i], coll->compid[i]);
+            }
+            unsigned lanes = lanes_comm;
+            if(coll->usage >> CommBench::numlib) {
+              lanes |= 1u << lane_compute;
+              if(!coll->pipelined)
+                depend_compute[lane_compute] |= lanes_comm | (1u << lane_compute); // own lane: start after the arrival
+            }
+            if(lanes) {
+              for(int lane = 0; lane < lib.size(); lane++)
+                if(lanes & (1u << lane))
+                  depend[lane] |= lane_prev[i];
+              lane_prev[i] = lanes;
             }
           }
-        if(coll_total->numcomm + coll_total->numcompute) {
+        if(busy) {
           for(int i = 0; i < lib.size(); i++) {
             coll_pipeline[i].push_back(coll_temp[i]);
-            pipeline[i].push_back(Command<T>(comm_temp[i], compute_temp[i]));
+            pipeline[i].push_back(Command<T, A>(comm_temp[i], compute_temp[i], compress_temp[i]));
+            pipeline[i].back().depend = depend[i];
+            pipeline[i].back().depend_compute = depend_compute[i];
           }
           coll_mixed.push_back(coll_total);
         }
@@ -150,9 +315,11 @@
             delete coll_temp[i];
             delete comm_temp[i];
             delete compute_temp[i];
+            delete compress_temp[i];
           }
         }
       }
+      CommBench::printid = printid_temp;
     }
     // REPORT MIXED PIPELINE
     for(int i = 0; i < coll_mixed.size(); i++)
@@ -164,3 +331,109 @@
     report_pipeline(coll_pipeline);
   }
 
+  // QUANTIZED PARTIAL SUMS READ BY ONE REDUCTION ONLY ARE NOT DEQUANTIZED ON ARRIVAL: THE REDUCTION READS THE RECEIVED STREAM
+  // AND DEQUANTIZES IN ITS SUM (IN THE ACCUMULATOR TYPE). A receive is fused if it lands in an intermediate buffer (scratch),
+  // one computation reads exactly its elements, and no transfer or other computation reads them before they are overwritten.
+  template <typename T, typename A>
+  void fuse_quantized(std::vector<std::list<Command<T, A>>> &pipeline, std::vector<std::list<Coll<T>*>> &coll_pipeline, const std::vector<std::pair<void*, size_t>> &scratch) {
+    struct Received {
+      T *ptr;
+      size_t count;
+      int code;
+      Compress<T> *compress;
+      int recv;
+      Compute<T, A> *compute;
+      int comp;
+      int in;
+      bool spoiled;
+    };
+    std::vector<Received> received;
+    std::list<int> active; // received whose data is current
+    auto overlap = [] (T *a, size_t na, T *b, size_t nb) {
+      return a < b + nb && b < a + na;
+    };
+    auto read = [&] (T *ptr, size_t count) {
+      for(int r : active)
+        if(overlap(ptr, count, received[r].ptr, received[r].count))
+          received[r].spoiled = true;
+    };
+    auto write = [&] (T *ptr, size_t count) {
+      active.remove_if([&] (int r) { return overlap(ptr, count, received[r].ptr, received[r].count); });
+    };
+    auto intermediate = [&] (T *ptr, size_t count) {
+      for(auto &buffer : scratch)
+        if((char*) ptr >= (char*) buffer.first && (char*) (ptr + count) <= (char*) buffer.first + buffer.second)
+          return true;
+      return false;
+    };
+    int numlane = pipeline.size();
+    std::vector<typename std::list<Command<T, A>>::iterator> command(numlane);
+    std::vector<typename std::list<Coll<T>*>::iterator> coll(numlane);
+    for(int lane = 0; lane < numlane; lane++) {
+      command[lane] = pipeline[lane].begin();
+      coll[lane] = coll_pipeline[lane].begin();
+    }
+    while(true) {
+      bool finished = true;
+      // TRANSFERS OF THE STEP: READS, THEN WRITES
+      for(int lane = 0; lane < numlane; lane++)
+        if(coll[lane] != coll_pipeline[lane].end()) {
+          finished = false;
+          Coll<T> *step = *coll[lane];
+          for(int i = 0; i < step->numcomm; i++)
+            if(step->sendid[i] == myid)
+              read(step->sendbuf[i] + step->sendoffset[i], step->count[i]);
+          int recv = 0;
+          for(int i = 0; i < step->numcomm; i++)
+            if(step->recvid[i] == myid) {
+              T *ptr = step->recvbuf[i] + step->recvoffset[i];
+              write(ptr, step->count[i]);
+              if(step->codec[i] != raw) {
+                if(step->codec[i] != lossless && intermediate(ptr, step->count[i])) {
+                  received.push_back({ptr, step->count[i], step->codec[i], command[lane]->compress, recv, nullptr, -1, -1, false});
+                  active.push_back(received.size() - 1);
+                }
+                recv++;
+              }
+            }
+        }
+      if(finished)
+        break;
+      // COMPUTATIONS OF THE STEP
+      for(int lane = 0; lane < numlane; lane++)
+        if(coll[lane] != coll_pipeline[lane].end()) {
+          Coll<T> *step = *coll[lane];
+          int comp = 0;
+          for(int i = 0; i < step->numcompute; i++)
+            if(step->compid[i] == myid) {
+              for(int in = 0; in < step->inputbuf[i].size(); in++) {
+                T *ptr = step->inputbuf[i][in];
+                bool match = false;
+                for(int r : active)
+                  if(received[r].ptr == ptr && received[r].count == step->numreduce[i] && received[r].compute == nullptr && !received[r].spoiled) {
+                    received[r].compute = command[lane]->compute;
+                    received[r].comp = comp;
+                    received[r].in = in;
+                    match = true;
+                    break;
+                  }
+                if(!match)
+                  read(ptr, step->numreduce[i]);
+              }
+              write(step->outputbuf[i], step->numreduce[i]);
+              comp++;
+            }
+          coll[lane]++;
+          command[lane]++;
+        }
+    }
+    int numfused = 0;
+    for(auto &r : received)
+      if(r.compute && !r.spoiled) {
+        r.compute->fuse(r.comp, r.in, r.compress->fuse(r.recv), r.code);
+        numfused++;
+      }
+    MPI_Allreduce(MPI_IN_PLACE, &numfused, 1, MPI_INT, MPI_SUM, comm_mpi);
+    if(myid == printid && numfused)
+      printf("quantized partial sums reduced as received: %d\n", numfused);
+  }
@@ -0,0 +1,487 @@
+
+  // LOSSLESS CODEC: BYTE-PLANE SHUFFLE FOLLOWED BY ZERO-RUN-LENGTH ENCODING
+  // The stream is a header (number of blocks and encoded size of each block) followed by independently encoded blocks,
+  // so that blocks are encoded and decoded in parallel and the receiver learns the sizes from the message itself.
+  // Token of the run-length encoding: 0x80 | n for a run of n zeros, n (1 <= n <= 127) for n literal bytes that follow.
+
+  static const size_t codec_block = 1 << 16; // bytes per block (rounded down to a multiple of the element size)
+
+  inline size_t codec_blocksize(int width) {
+    return codec_block / width * width;
+  }
+  inline size_t codec_numblock(size_t bytes, int width) {
+    return (bytes + codec_blocksize(width) - 1) / codec_blocksize(width);
+  }
+  inline size_t codec_blockbound(size_t bytes) {
+    return bytes + bytes / 127 + 2;
+  }
+  inline size_t codec_bound(size_t bytes, int width) {
+    size_t numblock = codec_numblock(bytes, width);
+    return sizeof(size_t) * (numblock + 1) + numblock * codec_blockbound(codec_blocksize(width));
+  }
+
+  inline size_t encode_block(const unsigned char *input, size_t bytes, int width, unsigned char *output) {
+    // SHUFFLE INTO BYTE PLANES
+    std::vector<unsigned char> plane(bytes);
+    size_t numelement = bytes / width;
+    for(int k = 0; k < width; k++)
+      for(size_t e = 0; e < numelement; e++)
+        plane[k * numelement + e] = input[e * width + k];
+    // RUN-LENGTH ENCODE ZEROS
+    size_t outsize = 0;
+    size_t pos = 0;
+    while(pos < bytes) {
+      if(plane[pos] == 0 && (pos + 1 == bytes || plane[pos + 1] == 0)) {
+        int run = 1;
+        while(pos + run < bytes && run < 127 && plane[pos + run] == 0)
+          run++;
+        output[outsize++] = 0x80 | run;
+        pos += run;
+      }
+      else {
+        size_t token = outsize++;
+        int run = 0;
+        while(pos < bytes && run < 127 && !(plane[pos] == 0 && (pos + 1 == bytes || plane[pos + 1] == 0))) {
+          output[outsize++] = plane[pos++];
+          run++;
+        }
+        output[token] = run;
+      }
+    }
+    return outsize;
+  }
+
+  inline void decode_block(const unsigned char *input, size_t insize, size_t bytes, int width, unsigned char *output) {
+    // RUN-LENGTH DECODE
+    std::vector<unsigned char> plane(bytes);
+    size_t pos = 0;
+    for(size_t i = 0; i < insize && pos < bytes;) {
+      int run = input[i] & 0x7F;
+      if(input[i++] & 0x80) {
+        memset(plane.data() + pos, 0, run);
+        pos += run;
+      }
+      else {
+        memcpy(plane.data() + pos, input + i, run);
+        pos += run;
+        i += run;
+      }
+    }
+    // UNSHUFFLE BYTE PLANES
+    size_t numelement = bytes / width;
+    for(int k = 0; k < width; k++)
+      for(size_t e = 0; e < numelement; e++)
+        output[e * width + k] = plane[k * numelement + e];
+  }
+
+  // ENCODE bytes OF input INTO output (AT LEAST codec_bound BYTES), RETURNS THE ENCODED SIZE
+  inline size_t encode(const void *input, size_t bytes, int width, void *output) {
+    size_t blocksize = codec_blocksize(width);
+    size_t blockbound = codec_blockbound(blocksize);
+    size_t numblock = codec_numblock(bytes, width);
+    size_t *header = (size_t*) output;
+    unsigned char *payload = (unsigned char*) (header + numblock + 1);
+    header[0] = numblock;
+    #pragma omp parallel for schedule(dynamic)
+    for(size_t block = 0; block < numblock; block++) {
+      size_t offset = block * blocksize;
+      size_t size = (bytes - offset < blocksize ? bytes - offset : blocksize);
+      header[block + 1] = encode_block((const unsigned char*) input + offset, size, width, payload + block * blockbound);
+    }
+    // COMPACT BLOCKS (EACH MOVES TOWARDS THE FRONT)
+    size_t outsize = 0;
+    for(size_t block = 0; block < numblock; block++) {
+      memmove(payload + outsize, payload + block * blockbound, header[block + 1]);
+      outsize += header[block + 1];
+    }
+    return sizeof(size_t) * (numblock + 1) + outsize;
+  }
+
+  // DECODE input INTO bytes OF output, RETURNS false IF THE STREAM DOES NOT MATCH
+  inline bool decode(const void *input, size_t insize, size_t bytes, int width, void *output) {
+    size_t blocksize = codec_blocksize(width);
+    size_t numblock = codec_numblock(bytes, width);
+    const size_t *header = (const size_t*) input;
+    if(insize < sizeof(size_t) * (numblock + 1) || header[0] != numblock)
+      return false;
+    std::vector<size_t> blockoffset(numblock + 1, 0);
+    for(size_t block = 0; block < numblock; block++)
+      blockoffset[block + 1] = blockoffset[block] + header[block + 1];
+    const unsigned char *payload = (const unsigned char*) (header + numblock + 1);
+    if(sizeof(size_t) * (numblock + 1) + blockoffset[numblock] != insize)
+      return false;
+    #pragma omp parallel for schedule(dynamic)
+    for(size_t block = 0; block < numblock; block++) {
+      size_t offset = block * blocksize;
+      size_t size = (bytes - offset < blocksize ? bytes - offset : blocksize);
+      decode_block(payload + blockoffset[block], header[block + 1], size, width, (unsigned char*) output + offset);
+    }
+    return true;
+  }
+
+  // QUANTIZATION OF PARTIAL SUMS (LOSSY)
+  // quantize8: each chunk of quant_chunk elements is scaled by its own factor (max magnitude / 127) into 8-bit integers;
+  // the stream is the float scale of every chunk followed by the integers. bfloat16: each element is rounded to 16 bits.
+  // With a residual (error feedback), the rounding error of a call is added to the input of the next call on the same
+  // transfer, so that the error of a sum over many calls stays bounded instead of growing with the number of calls.
+  // A partial sum that is only read by a reduction is not dequantized on arrival: the reduction reads the stream (see Compute).
+
+  inline size_t quant_numchunk(size_t count) {
+    return (count + quant_chunk - 1) / quant_chunk;
+  }
+  inline size_t quant_bound(size_t count, int code) {
+    if(code == quantize8)
+      return quant_numchunk(count) * sizeof(float) + count * sizeof(int8_t);
+    return count * sizeof(uint16_t);
+  }
+
+  // QUANTIZE count ELEMENTS OF input INTO output (quant_bound BYTES), residual IS UPDATED IF NOT nullptr
+  template <typename T>
+  void quantize(const T *input, size_t count, int code, T *residual, void *output) {
+    size_t numchunk = quant_numchunk(count);
+    float *scale = (float*) output;
+    int8_t *value8 = (int8_t*) (scale + numchunk);
+    uint16_t *value16 = (uint16_t*) output;
+    #pragma omp parallel for
+    for(size_t chunk = 0; chunk < numchunk; chunk++) {
+      size_t begin = chunk * quant_chunk;
+      size_t end = (begin + quant_chunk < count ? begin + quant_chunk : count);
+      if(code == quantize8) {
+        float maxabs = 0;
+        for(size_t e = begin; e < end; e++) {
+          float x = input[e] + (residual ? residual[e] : T(0));
+          if(std::fabs(x) > maxabs)
+            maxabs = std::fabs(x);
+        }
+        float s = (std::isfinite(maxabs) ? maxabs / 127 : 0);
+        scale[chunk] = s;
+        for(size_t e = begin; e < end; e++) {
+          T x = input[e] + (residual ? residual[e] : T(0));
+          long q = (s > 0 ? std::lround(x / s) : 0);
+          q = (q > 127 ? 127 : (q < -127 ? -127 : q));
+          value8[e] = q;
+          if(residual)
+            residual[e] = x - (T) (q * s);
+        }
+      }
+      else
+        for(size_t e = begin; e < end; e++) {
+          T x = input[e] + (residual ? residual[e] : T(0));
+          value16[e] = float_to_bfloat16(x);
+          if(residual)
+            residual[e] = x - (T) bfloat16_to_float(value16[e]);
+        }
+    }
+  }
+
+  template <typename T>
+  void dequantize(const void *input, size_t count, int code, T *output) {
+    size_t numchunk = quant_numchunk(count);
+    const float *scale = (const float*) input;
+    const int8_t *value8 = (const int8_t*) (scale + numchunk);
+    const uint16_t *value16 = (const uint16_t*) input;
+    #pragma omp parallel for
+    for(size_t chunk = 0; chunk < numchunk; chunk++) {
+      size_t begin = chunk * quant_chunk;
+      size_t end = (begin + quant_chunk < count ? begin + quant_chunk : count);
+      for(size_t e = begin; e < end; e++)
+        output[e] = (code == quantize8 ? (T) (value8[e] * scale[chunk]) : (T) bfloat16_to_float(value16[e]));
+    }
+  }
+
+  // MESSAGES OF A COMPRESSED TRANSFER: MPI COUNTS ARE int, SO A STREAM IS SENT IN PIECES OF AT MOST compress_message BYTES.
+  // The receiver does not know the encoded size, both sides use the pieces of the bound (trailing pieces may be empty).
+  static const size_t compress_message = 1 << 30;
+  static int compress_thread_level = -1;
+
+  inline int compress_numpiece(size_t bound) {
+    return std::max((bound + compress_message - 1) / compress_message, (size_t) 1);
+  }
+
+#if defined PORT_CUDA || defined PORT_HIP || defined PORT_SYCL
+  // PINNED HOST STAGING OF DEVICE DATA
+  template <typename T>
+  T* allocate_pinned(size_t count) {
+    T *buffer = nullptr;
+    if(count == 0)
+      return buffer;
+#ifdef PORT_CUDA
+    cudaMallocHost(&buffer, count * sizeof(T));
+#elif defined PORT_HIP
+    hipHostMalloc(&buffer, count * sizeof(T));
+#elif defined PORT_SYCL
+    buffer = sycl::malloc_host<T>(count, CommBench::q);
+#endif
+    return buffer;
+  }
+  template <typename T>
+  void free_pinned(T *buffer) {
+    if(buffer == nullptr)
+      return;
+#ifdef PORT_CUDA
+    cudaFreeHost(buffer);
+#elif defined PORT_HIP
+    hipHostFree(buffer);
+#elif defined PORT_SYCL
+    sycl::free(buffer, CommBench::q);
+#endif
+  }
+#endif
+
+  // The encoding of the sends runs on the host reduction pool when it has threads (set_compute_threads) and MPI allows
+  // calls from any thread, so that start() returns after posting the receives; each send is posted as soon as it and all
+  // sends before it are encoded (messages to the same process match in the order of add). Otherwise start() encodes.
+  template <typename T>
+  class Compress {
+
+    public:
+
+    int numsend = 0;
+    int numrecv = 0;
+
+    // SEND
+    std::vector<T*> sendbuf;
+    std::vector<size_t> sendcount;
+    std::vector<int> sendproc;
+    std::vector<int> sendlevel;
+    std::vector<int> sendcode;
+    std::vector<std::shared_ptr<std::vector<T>>> residual; // error feedback of quantized sends (shared by the rebound pipelines)
+    std::vector<std::vector<char>> sendstage;
+    std::vector<size_t> sendsize; // encoded
+    std::vector<MPI_Request> sendrequest; // pieces, from sendfirst
+    std::vector<int> sendfirst;
+    std::vector<bool> sendready;
+    int sendnext = 0; // next send to post
+    std::atomic<int> pending{0}; // encodings in flight
+    pthread_mutex_t post_mutex = PTHREAD_MUTEX_INITIALIZER;
+    // RECEIVE
+    std::vector<T*> recvbuf;
+    std::vector<size_t> recvcount;
+    std::vector<int> recvproc;
+    std::vector<int> recvlevel;
+    std::vector<int> recvcode;
+    std::vector<std::vector<char>> recvstage;
+    std::vector<MPI_Request> recvrequest; // pieces, from recvfirst
+    std::vector<int> recvfirst;
+    std::vector<int> recvowner; // of each piece
+    std::vector<std::shared_ptr<char>> recvfused; // streams read by reductions as received (device memory on GPUs), or nullptr
+#if defined PORT_CUDA || defined PORT_HIP || defined PORT_SYCL
+    std::vector<T*> sendhost; // pinned copies of device data
+    std::vector<T*> recvhost;
+#endif
+
+    // STATISTICS PER LEVEL (BYTES ON THE SENDER SIDE, TIME UNTIL THE LAST TRANSFER OF THE LEVEL IS DECODED ON THE RECEIVER SIDE)
+    std::vector<size_t> rawbytes;
+    std::vector<size_t> zipbytes;
+    std::vector<double> ziptime;
+    double starttime;
+
+    bool feedback = false; // keep residuals of quantized sends across calls
+    int tag = 0; // lane, since lanes may progress out of order
+    MPI_Comm comm = MPI_COMM_NULL; // of the plan (set by Comm::isolate, on all processes before any start)
+
+    Compress() {
+      if(compress_thread_level == -1)
+        MPI_Query_thread(&compress_thread_level);
+    }
+
+    ~Compress() {
+      while(pending)
+        sched_yield();
+#if defined PORT_CUDA || defined PORT_HIP || defined PORT_SYCL
+      for(auto &host : sendhost)
+        free_pinned(host);
+      for(auto &host : recvhost)
+        free_pinned(host);
+#endif
+    }
+
+    static size_t bound(size_t count, int code) {
+      return (code == lossless ? codec_bound(count * sizeof(T), sizeof(T)) : quant_bound(count, code));
+    }
+
+    void add(T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count, int sendid, int recvid, int level, int code = lossless) {
+      if(myid == sendid || myid == recvid)
+        if(level >= ziptime.size()) {
+          rawbytes.resize(level + 1, 0);
+          zipbytes.resize(level + 1, 0);
+          ziptime.resize(level + 1, 0);
+        }
+      if(myid == sendid) {
+        this->sendbuf.push_back(sendbuf + sendoffset);
+        sendcount.push_back(count);
+        sendproc.push_back(recvid);
+        sendlevel.push_back(level);
+        sendcode.push_back(code);
+        residual.push_back(feedback && code != lossless ? std::make_shared<std::vector<T>>(count, 0) : nullptr);
+        sendstage.push_back(std::vector<char>(bound(count, code)));
+        sendsize.push_back(0);
+        sendfirst.push_back(sendrequest.size());
+        sendrequest.resize(sendrequest.size() + compress_numpiece(sendstage.back().size()), MPI_REQUEST_NULL);
+        sendready.push_back(false);
+#if defined PORT_CUDA || defined PORT_HIP || defined PORT_SYCL
+        sendhost.push_back(allocate_pinned<T>(count));
+#endif
+        numsend++;
+      }
+      if(myid == recvid) {
+        this->recvbuf.push_back(recvbuf + recvoffset);
+        recvcount.push_back(count);
+        recvproc.push_back(sendid);
+        recvlevel.push_back(level);
+        recvcode.push_back(code);
+        recvstage.push_back(std::vector<char>(bound(count, code)));
+        recvfirst.push_back(recvrequest.size());
+        recvrequest.resize(recvrequest.size() + compress_numpiece(recvstage.back().size()), MPI_REQUEST_NULL);
+        recvowner.resize(recvrequest.size(), numrecv);
+        recvfused.push_back(nullptr);
+#if defined PORT_CUDA || defined PORT_HIP || defined PORT_SYCL
+        recvhost.push_back(allocate_pinned<T>(count));
+#endif
+        numrecv++;
+      }
+    }
+
+    // KEEP RECEIVE recv QUANTIZED FOR A REDUCTION, RETURNS THE STREAM IT READS
+    const char* fuse(int recv) {
+      size_t bytes = recvstage[recv].size();
+#if defined PORT_CUDA || defined PORT_HIP || defined PORT_SYCL
+      char *stream;
+      CommBench::allocate(stream, bytes);
+      recvfused[recv] = std::shared_ptr<char>(stream, [] (char *stream) { CommBench::free(stream); });
+#else
+      recvfused[recv] = std::shared_ptr<char>(new char[bytes], std::default_delete<char[]>());
+      std::vector<char>().swap(recvstage[recv]); // received in place
+#endif
+      return recvfused[recv].get();
+    }
+    // THE SAME RESIDUALS AND QUANTIZED RECEIVES AS other (BUILT FROM THE SAME TRANSFERS)
+    void share(const Compress<T> &other) {
+      residual = other.residual;
+      for(int recv = 0; recv < numrecv; recv++)
+        if(other.recvfused[recv]) {
+          recvfused[recv] = other.recvfused[recv];
+#if !defined PORT_CUDA && !defined PORT_HIP && !defined PORT_SYCL
+          std::vector<char>().swap(recvstage[recv]);
+#endif
+        }
+    }
+    // BYTES OF RECEIVE recv AND WHERE THEY ARRIVE
+    size_t recvbytes(int recv) {
+      return bound(recvcount[recv], recvcode[recv]);
+    }
+    char* recvdata(int recv) {
+#if defined PORT_CUDA || defined PORT_HIP || defined PORT_SYCL
+      return recvstage[recv].data();
+#else
+      return (recvfused[recv] ? recvfused[recv].get() : recvstage[recv].data());
+#endif
+    }
+
+    // ENCODE A SEND, THEN POST THE ENCODED SENDS IN ORDER
+    void encode_send(int send) {
+#if defined PORT_CUDA || defined PORT_HIP || defined PORT_SYCL
+      CommBench::memcpyD2H(sendhost[send], sendbuf[send], sendcount[send]);
+      const T *input = sendhost[send];
+#else
+      const T *input = sendbuf[send];
+#endif
+      if(sendcode[send] == lossless)
+        sendsize[send] = encode(input, sendcount[send] * sizeof(T), sizeof(T), sendstage[send].data());
+      else {
+        quantize(input, sendcount[send], sendcode[send], residual[send] ? residual[send]->data() : nullptr, sendstage[send].data());
+        sendsize[send] = sendstage[send].size();
+      }
+      pthread_mutex_lock(&post_mutex);
+      sendready[send] = true;
+      for(; sendnext < numsend && sendready[sendnext]; sendnext++) {
+        int next = sendnext;
+        int numpiece = compress_numpiece(sendstage[next].size());
+        for(int piece = 0; piece < numpiece; piece++) {
+          size_t offset = piece * compress_message;
+          size_t size = (sendsize[next] > offset ? std::min(sendsize[next] - offset, compress_message) : 0);
+          MPI_Isend(sendstage[next].data() + offset, size, MPI_BYTE, sendproc[next], tag, comm, &sendrequest[sendfirst[next] + piece]);
+        }
+      }
+      pthread_mutex_unlock(&post_mutex);
+    }
+
+    void start() {
+      starttime = MPI_Wtime();
+      for(int recv = 0; recv < numrecv; recv++) {
+        size_t bytes = recvbytes(recv);
+        int numpiece = compress_numpiece(bytes);
+        for(int piece = 0; piece < numpiece; piece++) {
+          size_t offset = piece * compress_message;
+          MPI_Irecv(recvdata(recv) + offset, std::min(bytes - offset, compress_message), MPI_BYTE, recvproc[recv], tag, comm, &recvrequest[recvfirst[recv] + piece]);
+        }
+      }
+      sendnext = 0;
+      for(int send = 0; send < numsend; send++)
+        sendready[send] = false;
+      if(numsend && host_threads() && compress_thread_level == MPI_THREAD_MULTIPLE) {
+        std::vector<std::function<void()>> tasks;
+        pending = numsend;
+        for(int send = 0; send < numsend; send++)
+          tasks.push_back([this, send] () {
+            encode_send(send);
+            pending--;
+          });
+        host_submit(tasks);
+      }
+      else
+        for(int send = 0; send < numsend; send++)
+          encode_send(send);
+    }
+
+    void wait() {
+      // DECODE THE RECEIVES IN THE ORDER OF ARRIVAL
+      std::vector<int> remain(numrecv);
+      std::vector<size_t> size(numrecv, 0);
+      for(int recv = 0; recv < numrecv; recv++)
+        remain[recv] = compress_numpiece(recvbytes(recv));
+      std::vector<double> time(ziptime.size(), 0);
+      for(int arrived = 0; arrived < recvrequest.size(); arrived++) {
+        int index;
+        MPI_Status status;
+        MPI_Waitany(recvrequest.size(), recvrequest.data(), &index, &status);
+        int recv = recvowner[index];
+        int piece;
+        MPI_Get_count(&status, MPI_BYTE, &piece);
+        size[recv] += piece;
+        if(--remain[recv])
+          continue;
+#if defined PORT_CUDA || defined PORT_HIP || defined PORT_SYCL
+        T *output = recvhost[recv];
+#else
+        T *output = recvbuf[recv];
+#endif
+        bool pass;
+        if(recvcode[recv] == lossless)
+          pass = decode(recvstage[recv].data(), size[recv], recvcount[recv] * sizeof(T), sizeof(T), output);
+        else {
+          pass = (size[recv] == recvbytes(recv));
+          if(pass && recvfused[recv] == nullptr)
+            dequantize(recvstage[recv].data(), recvcount[recv], recvcode[recv], output);
+        }
+#if defined PORT_CUDA || defined PORT_HIP || defined PORT_SYCL
+        if(recvfused[recv])
+          CommBench::memcpyH2D(recvfused[recv].get(), recvstage[recv].data(), size[recv]); // quantized, a fraction of the data
+        else
+          CommBench::memcpyH2D(recvbuf[recv], recvhost[recv], recvcount[recv]);
+#endif
+        if(!pass)
+          printf("ERROR!!! myid %d cannot decode %zu bytes from %d\n", myid, size[recv], recvproc[recv]);
+        time[recvlevel[recv]] = MPI_Wtime() - starttime;
+      }
+      while(pending)
+        sched_yield();
+      MPI_Waitall(sendrequest.size(), sendrequest.data(), MPI_STATUSES_IGNORE);
+      for(int send = 0; send < numsend; send++) {
+        rawbytes[sendlevel[send]] += sendcount[send] * sizeof(T);
+        zipbytes[sendlevel[send]] += sendsize[send];
+      }
+      for(int level = 0; level < ziptime.size(); level++)
+        ziptime[level] += time[level];
+    }
+  };
@@ -1,29 +1,252 @@
 
+  // DESCRIPTOR OF ONE REDUCTION IN A BATCH: INPUTS OF TYPE T ARE CONVERTED AND SUMMED IN THE ACCUMULATOR TYPE A,
+  // THE SUM IS CONVERTED BACK ON STORE. Reductions are laid out back to back in blocks, block is the first block.
+  // Quantized partial sums are read as received (code per input, nullptr if all are raw) and dequantized in the sum:
+  // quantize8 inputs point to the 8-bit values and scale to the scale of every quant_chunk elements.
+  template <typename T>
+  struct Reduction {
+    T *output;
+    T **input;
+    int numinput;
+    size_t count;
+    size_t block;
+    const char *code;
+    const float **scale;
+  };
+
+  static const size_t quant_chunk = 256; // elements per scale of quantize8
+
+  template <typename T, typename A>
 #if defined PORT_CUDA || defined PORT_HIP
+  __host__ __device__
+#endif
+  inline A load_input(const Reduction<T> &reduction, int in, size_t i) {
+    if(reduction.code == nullptr || reduction.code[in] == raw)
+      return (A) reduction.input[in][i];
+    if(reduction.code[in] == quantize8)
+      return (A) (((const int8_t*) reduction.input[in])[i] * reduction.scale[in][i / quant_chunk]);
+    uint32_t bits = (uint32_t) ((const uint16_t*) reduction.input[in])[i] << 16; // bfloat16
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    return (A) value;
+  }
+
+  // FIND THE REDUCTION OF A BLOCK (LAST ONE STARTING AT OR BEFORE IT)
   template <typename T>
-  __global__ void reduce_kernel(T *output, size_t count, T **input, int numinput) {
-     size_t i = blockIdx.x * blockDim.x + threadIdx.x;
-     if(i < count) {
-       T acc = 0;
-       for(int in = 0; in < numinput; in++)
-         acc += input[in][i];
-       output[i] = acc;
-     }
+#if defined PORT_CUDA || defined PORT_HIP
+  __host__ __device__
+#endif
+  inline int find_reduction(const Reduction<T> *table, int numcomp, size_t block) {
+    int lo = 0;
+    int hi = numcomp - 1;
+    while(lo < hi) {
+      int mid = (lo + hi + 1) / 2;
+      if(table[mid].block <= block)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    return lo;
+  }
+
+  // ALL REDUCTIONS OF A COMMAND IN ONE LAUNCH, WORK IS DIVIDED INTO BLOCKS BY SIZE
+#if defined PORT_CUDA || defined PORT_HIP
+  static const size_t reduce_blocksize = 256;
+  template <typename T, typename A>
+  __global__ void reduce_kernel(const Reduction<T> *table, int numcomp) {
+    const Reduction<T> &reduction = table[find_reduction(table, numcomp, blockIdx.x)];
+    size_t i = (blockIdx.x - reduction.block) * blockDim.x + threadIdx.x;
+    if(i < reduction.count) {
+      A acc = 0;
+      for(int in = 0; in < reduction.numinput; in++)
+        acc += load_input<T, A>(reduction, in, i);
+      reduction.output[i] = (T) acc;
+    }
   }
+#elif defined PORT_SYCL
+  static const size_t reduce_blocksize = 256;
 #else
-  template <typename T>
-  void reduce_kernel(T *output, size_t count, T **input, int numinput) {
-    #pragma omp parallel for
-    for(size_t i = 0; i < count; i++) {
-      T acc = 0;
-      for(int in = 0; in < numinput; in++)
-        acc += input[in][i];
-      output[i] = acc;
+  static const size_t reduce_blocksize = 1 << 14;
+  template <typename T, typename A>
+  void reduce_block(const Reduction<T> *table, int numcomp, size_t block) {
+    const Reduction<T> &reduction = table[find_reduction(table, numcomp, block)];
+    size_t begin = (block - reduction.block) * reduce_blocksize;
+    size_t end = std::min(begin + reduce_blocksize, reduction.count);
+    for(size_t i = begin; i < end; i++) {
+      A acc = 0;
+      for(int in = 0; in < reduction.numinput; in++)
+        acc += load_input<T, A>(reduction, in, i);
+      reduction.output[i] = (T) acc;
     }
   }
+  template <typename T, typename A>
+  void reduce_kernel(const Reduction<T> *table, int numcomp, size_t numblock) {
+    #pragma omp parallel for schedule(static)
+    for(size_t block = 0; block < numblock; block++)
+      reduce_block<T, A>(table, numcomp, block);
+  }
 #endif
 
-  template <typename T>
+  // HOST REDUCTION POOL
+  // Host reductions run on dedicated threads (optionally pinned to cores), so the thread that drives the communication
+  // is free while they run, as with GPU streams. With zero threads (default), reductions run in the calling thread (OpenMP).
+  // The host codec of compressed transfers (compress.h) also runs on the pool, on every port.
+  // The pool is configured by set_compute_threads() only (never lazily by a reduction, which may run on several lane or
+  // request threads at once). Reconfigure only when no reduction is in flight.
+  static pthread_mutex_t host_mutex = PTHREAD_MUTEX_INITIALIZER;
+  static pthread_mutex_t host_config_mutex = PTHREAD_MUTEX_INITIALIZER; // serializes reconfigurations (joins need host_mutex free)
+  static pthread_cond_t host_cond = PTHREAD_COND_INITIALIZER;
+  static std::deque<std::function<void()>> host_queue;
+  static std::vector<pthread_t> host_thread;
+  static std::vector<int> host_cores;
+  static int host_numthread = 0; // inline (OpenMP) unless configured
+  static bool host_quit = false;
+
+  inline void* host_loop(void *arg) {
+    CommBench::setup_gpu();
+    pthread_mutex_lock(&host_mutex);
+    while(true) {
+      while(host_queue.empty() && !host_quit)
+        pthread_cond_wait(&host_cond, &host_mutex);
+      if(host_queue.empty())
+        break;
+      std::function<void()> task = host_queue.front();
+      host_queue.pop_front();
+      pthread_mutex_unlock(&host_mutex);
+      task();
+      pthread_mutex_lock(&host_mutex);
+    }
+    pthread_mutex_unlock(&host_mutex);
+    return NULL;
+  }
+
+  // CORES THIS PROCESS MAY RUN ON (ITS AFFINITY MASK, e.g., ITS SHARE OF A NODE WITH SEVERAL RANKS)
+  inline int host_numcore() {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if(sched_getaffinity(0, sizeof(cpu_set_t), &cpuset) == 0)
+      return std::max(CPU_COUNT(&cpuset), 1);
+    return 1;
+  }
+
+  inline void set_compute_threads(int numthread, std::vector<int> cores = std::vector<int>()) {
+    pthread_mutex_lock(&host_config_mutex);
+    pthread_mutex_lock(&host_mutex);
+    host_quit = true;
+    pthread_cond_broadcast(&host_cond);
+    pthread_mutex_unlock(&host_mutex);
+    for(auto &thread : host_thread)
+      pthread_join(thread, NULL);
+    pthread_mutex_lock(&host_mutex);
+    host_thread.clear();
+    host_quit = false;
+    host_numthread = std::max(numthread, 0);
+    host_cores = cores;
+    pthread_mutex_unlock(&host_mutex);
+    for(int t = 0; t < numthread; t++) {
+      pthread_t thread;
+      pthread_create(&thread, NULL, host_loop, NULL);
+      if(cores.size()) {
+        int core = cores[t % cores.size()];
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(core, &cpuset);
+        if(pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset))
+          printf("HiCCL: myid %d cannot pin compute thread to core %d\n", myid, core);
+      }
+      host_thread.push_back(thread);
+    }
+    pthread_mutex_unlock(&host_config_mutex);
+  }
+
+  inline int host_threads() {
+    pthread_mutex_lock(&host_mutex);
+    int numthread = host_numthread;
+    pthread_mutex_unlock(&host_mutex);
+    return numthread;
+  }
+
+  inline void host_submit(std::vector<std::function<void()>> &tasks) {
+    pthread_mutex_lock(&host_mutex);
+    for(auto &task : tasks)
+      host_queue.push_back(task);
+    pthread_cond_broadcast(&host_cond);
+    pthread_mutex_unlock(&host_mutex);
+  }
+
+  // PER-PROCESS POOL OF STREAMS AND DESCRIPTOR TABLES
+  // A Compute holds one stream and one table while it exists and returns them on destruction, rebound plans reuse them.
+#ifdef PORT_CUDA
+  typedef cudaStream_t stream_t;
+#elif defined PORT_HIP
+  typedef hipStream_t stream_t;
+#elif defined PORT_SYCL
+  typedef sycl::queue stream_t;
+#else
+  typedef int stream_t; // no streams on the host
+#endif
+  static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+  static std::vector<stream_t*> pool_stream;
+  static std::multimap<size_t, char*> pool_table; // free tables by capacity in bytes
+  static int pool_numstream = 0;
+  static size_t pool_tablesize = 0;
+
+  inline stream_t* acquire_stream() {
+    stream_t *stream = nullptr;
+    pthread_mutex_lock(&pool_mutex);
+    if(pool_stream.size()) {
+      stream = pool_stream.back();
+      pool_stream.pop_back();
+    }
+    else
+      pool_numstream++;
+    pthread_mutex_unlock(&pool_mutex);
+    if(stream == nullptr) {
+#ifdef PORT_CUDA
+      stream = new cudaStream_t();
+      cudaStreamCreate(stream);
+#elif defined PORT_HIP
+      stream = new hipStream_t();
+      hipStreamCreate(stream);
+#elif defined PORT_SYCL
+      stream = new sycl::queue(sycl::gpu_selector_v);
+#else
+      stream = new stream_t();
+#endif
+    }
+    return stream;
+  }
+  inline void release_stream(stream_t *stream) {
+    pthread_mutex_lock(&pool_mutex);
+    pool_stream.push_back(stream);
+    pthread_mutex_unlock(&pool_mutex);
+  }
+  // SMALLEST FREE TABLE THAT FITS, OTHERWISE A NEW ONE
+  inline char* acquire_table(size_t bytes, size_t &capacity) {
+    char *table = nullptr;
+    pthread_mutex_lock(&pool_mutex);
+    auto it = pool_table.lower_bound(bytes);
+    if(it != pool_table.end()) {
+      capacity = it->first;
+      table = it->second;
+      pool_table.erase(it);
+    }
+    else
+      pool_tablesize += bytes;
+    pthread_mutex_unlock(&pool_mutex);
+    if(table == nullptr) {
+      CommBench::allocate(table, bytes);
+      capacity = bytes;
+    }
+    return table;
+  }
+  inline void release_table(char *table, size_t capacity) {
+    pthread_mutex_lock(&pool_mutex);
+    pool_table.insert(std::make_pair(capacity, table));
+    pthread_mutex_unlock(&pool_mutex);
+  }
+
+  template <typename T, typename A = typename accumulator<T>::type>
   class Compute {
 
     public:
@@ -33,17 +256,35 @@
     std::vector<std::vector<T*>> inputbuf;
     std::vector<T*> outputbuf;
     std::vector<size_t> count;
-    std::vector<T**> inputbuf_d;
-#ifdef PORT_CUDA
-    std::vector<cudaStream_t*> stream;
-#elif defined PORT_HIP
-    std::vector<hipStream_t*> stream;
-#elif defined PORT_SYCL
-    std::vector<sycl::queue*> queue;
+    std::vector<std::vector<char>> inputcode; // raw, or quantized partial sums read as received (see fuse)
+    std::vector<std::vector<const float*>> inputscale;
+
+    // BATCH OF ALL REDUCTIONS, PACKED AT THE FIRST START AFTER add()
+    bool packed = false;
+    int numpack = 0; // reductions with nonzero count
+    size_t numblock = 0;
+    std::vector<Reduction<T>> table;
+    std::vector<T*> table_input;
+    std::vector<const float*> table_scale;
+    std::vector<char> table_code;
+    char *table_d = nullptr;
+    size_t table_capacity = 0;
+    stream_t *stream = nullptr;
+#ifdef PORT_SYCL
+    sycl::event event; // of the last start (a default event is complete)
 #endif
+    std::atomic<int> pending{0}; // host tasks in flight
 
     int printid = CommBench::printid;
 
+    ~Compute() {
+      wait();
+      if(table_d)
+        release_table(table_d, table_capacity);
+      if(stream)
+        release_stream(stream);
+    }
+
     void add(std::vector<T*> &inputbuf, T *outputbuf, size_t count, int compid) {
       if(printid > -1) {
         MPI_Barrier(comm_mpi);
@@ -67,53 +308,168 @@
         this->inputbuf.push_back(inputbuf); // CPU COPY OF GPU POINTERS
         this->outputbuf.push_back(outputbuf);
         this->count.push_back(count);
-        T **inputbuf_d;
-	CommBench::allocate(inputbuf_d, inputbuf.size());
-        CommBench::memcpyH2D(inputbuf_d, inputbuf.data(), inputbuf.size());
-#ifdef PORT_CUDA
-        stream.push_back(new cudaStream_t());
-        cudaStreamCreate(stream[numcomp]);
-#elif defined PORT_HIP
-        stream.push_back(new hipStream_t());
-        hipStreamCreate(stream[numcomp]);
-#elif defined PORT_SYCL
-        queue.push_back(new sycl::queue(sycl::gpu_selector_v));
-#endif
-        this->inputbuf_d.push_back(inputbuf_d);
+        inputcode.push_back(std::vector<char>(inputbuf.size(), raw));
+        inputscale.push_back(std::vector<const float*>(inputbuf.size(), nullptr));
+        packed = false;
         numcomp++;
       }
     }
 
-    void start() {
+    // READ INPUT in OF REDUCTION comp AS A QUANTIZED STREAM (SCALES, THEN VALUES, AS ENCODED BY quantize) OF count[comp] ELEMENTS
+    void fuse(int comp, int in, const char *stream, int code) {
+      inputcode[comp][in] = code;
+      inputscale[comp][in] = (code == quantize8 ? (const float*) stream : nullptr);
+      inputbuf[comp][in] = (T*) (code == quantize8 ? stream + (count[comp] + quant_chunk - 1) / quant_chunk * sizeof(float) : stream);
+      packed = false;
+    }
+    // THE SAME QUANTIZED INPUTS AS other (BUILT FROM THE SAME COMPUTATIONS, e.g., REBOUND TO OTHER USER BUFFERS)
+    void fuse(const Compute<T, A> &other) {
+      for(int comp = 0; comp < numcomp; comp++)
+        for(int in = 0; in < inputbuf[comp].size(); in++)
+          if(other.inputcode[comp][in] != raw) {
+            inputcode[comp][in] = other.inputcode[comp][in];
+            inputscale[comp][in] = other.inputscale[comp][in];
+            inputbuf[comp][in] = other.inputbuf[comp][in];
+            packed = false;
+          }
+    }
+
+    // ONE DESCRIPTOR TABLE (REDUCTIONS FOLLOWED BY THEIR INPUT POINTERS, SCALE POINTERS AND CODES) IN A POOLED DEVICE BUFFER
+    void pack() {
+      table.clear();
+      table_input.clear();
+      table_scale.clear();
+      table_code.clear();
+      numblock = 0;
       for(int comp = 0; comp < numcomp; comp++) {
+        if(count[comp] == 0)
+          continue;
+        bool quantized = false;
+        for(auto &code : inputcode[comp])
+          quantized |= (code != raw);
+        Reduction<T> reduction;
+        reduction.output = outputbuf[comp];
+        reduction.input = (T**) table_input.size(); // offsets until the table is placed
+        reduction.numinput = inputbuf[comp].size();
+        reduction.count = count[comp];
+        reduction.block = numblock;
+        reduction.code = (quantized ? (const char*) (table_code.size() + 1) : nullptr);
+        reduction.scale = (const float**) table_scale.size();
+        table.push_back(reduction);
+        table_input.insert(table_input.end(), inputbuf[comp].begin(), inputbuf[comp].end());
+        if(quantized) {
+          table_scale.insert(table_scale.end(), inputscale[comp].begin(), inputscale[comp].end());
+          table_code.insert(table_code.end(), inputcode[comp].begin(), inputcode[comp].end());
+        }
+        numblock += (count[comp] + reduce_blocksize - 1) / reduce_blocksize;
+      }
+      numpack = table.size();
+#if defined PORT_CUDA || defined PORT_HIP || defined PORT_SYCL
+      size_t bytes = table.size() * sizeof(Reduction<T>) + table_input.size() * sizeof(T*) + table_scale.size() * sizeof(float*) + table_code.size();
+      if(table_d && table_capacity < bytes) {
+        release_table(table_d, table_capacity);
+        table_d = nullptr;
+      }
+      if(table_d == nullptr && bytes)
+        table_d = acquire_table(bytes, table_capacity);
+      T **input_d = (T**) (table_d + table.size() * sizeof(Reduction<T>));
+      const float **scale_d = (const float**) (input_d + table_input.size());
+      char *code_d = (char*) (scale_d + table_scale.size());
+      for(auto &reduction : table) {
+        reduction.input = input_d + (size_t) reduction.input;
+        reduction.scale = scale_d + (size_t) reduction.scale;
+        if(reduction.code)
+          reduction.code = code_d + ((size_t) reduction.code - 1);
+      }
+      if(bytes) {
+        CommBench::memcpyH2D((Reduction<T>*) table_d, table.data(), table.size());
+        CommBench::memcpyH2D(input_d, table_input.data(), table_input.size());
+        if(table_code.size()) {
+          CommBench::memcpyH2D(scale_d, table_scale.data(), table_scale.size());
+          CommBench::memcpyH2D(code_d, table_code.data(), table_code.size());
+        }
+      }
+      if(stream == nullptr)
+        stream = acquire_stream();
+#else
+      for(auto &reduction : table) {
+        reduction.input = table_input.data() + (size_t) reduction.input;
+        reduction.scale = table_scale.data() + (size_t) reduction.scale;
+        if(reduction.code)
+          reduction.code = table_code.data() + ((size_t) reduction.code - 1);
+      }
+#endif
+      packed = true;
+    }
+
+    void start() {
+      if(!packed)
+        pack();
+      if(numblock == 0)
+        return;
 #if defined PORT_CUDA || defined PORT_HIP
-        int blocksize = 256;
-        reduce_kernel<T><<<(count[comp] + blocksize - 1) / blocksize, blocksize, 0, *stream[comp]>>> (outputbuf[comp], count[comp], inputbuf_d[comp], inputbuf[comp].size());
+      reduce_kernel<T, A><<<numblock, reduce_blocksize, 0, *stream>>> ((Reduction<T>*) table_d, numpack);
 #elif defined PORT_SYCL
-        T *output = outputbuf[comp];
-        int numinput = inputbuf[comp].size();
-        T **input = inputbuf_d[comp];
-        queue[comp]->parallel_for(sycl::range<1>{count[comp]}, [=] (sycl::id<1> i) {
-          T acc = 0;
-          for(int in = 0; in < numinput; in++)
-            acc += input[in][i];
-          output[i] = acc;
-        });
+      const Reduction<T> *table = (Reduction<T>*) table_d;
+      int numcomp = numpack;
+      event = stream->parallel_for(sycl::range<1>{numblock * reduce_blocksize}, [=] (sycl::id<1> id) {
+        size_t block = id / reduce_blocksize;
+        const Reduction<T> &reduction = table[find_reduction(table, numcomp, block)];
+        size_t i = (block - reduction.block) * reduce_blocksize + id % reduce_blocksize;
+        if(i < reduction.count) {
+          A acc = 0;
+          for(int in = 0; in < reduction.numinput; in++)
+            acc += load_input<T, A>(reduction, in, i);
+          reduction.output[i] = (T) acc;
+        }
+      });
 #else
-        reduce_kernel (outputbuf[comp], count[comp], inputbuf_d[comp], inputbuf[comp].size());
-#endif
+      int numthread = host_threads();
+      if(numthread == 0) {
+        reduce_kernel<T, A>(table.data(), numpack, numblock);
+        return;
+      }
+      // CONTIGUOUS RANGES OF EQUAL-SIZE BLOCKS
+      int numtask = std::min((size_t) numthread, numblock);
+      std::vector<std::function<void()>> tasks;
+      pending = numtask;
+      for(int task = 0; task < numtask; task++) {
+        size_t begin = numblock * task / numtask;
+        size_t end = numblock * (task + 1) / numtask;
+        tasks.push_back([this, begin, end] () {
+          for(size_t block = begin; block < end; block++)
+            reduce_block<T, A>(table.data(), numpack, block);
+          pending--;
+        });
       }
+      host_submit(tasks);
+#endif
+    }
+    // NONBLOCKING COMPLETION CHECK
+    bool test() {
+      if(stream == nullptr)
+        return pending == 0;
+#ifdef PORT_CUDA
+      return cudaStreamQuery(*stream) == cudaSuccess;
+#elif defined PORT_HIP
+      return hipStreamQuery(*stream) == hipSuccess;
+#elif defined PORT_SYCL
+      return event.get_info<sycl::info::event::command_execution_status>() == sycl::info::event_command_status::complete;
+#endif
+      return true;
     }
     void wait() {
-      for(int comp = 0; comp < numcomp; comp++) {
+      while(pending)
+        sched_yield();
+      if(stream == nullptr)
+        return;
 #ifdef PORT_CUDA
-        cudaStreamSynchronize(*stream[comp]);
+      cudaStreamSynchronize(*stream);
 #elif defined PORT_HIP
-        hipStreamSynchronize(*stream[comp]);
+      hipStreamSynchronize(*stream);
 #elif defined PORT_SYCL
-        queue[comp]->wait();
+      stream->wait();
 #endif
-      }
     }
 
     void report() {
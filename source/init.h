@@ -1,10 +1,65 @@
+    // PLAN THE BATCHES ON numthread THREADS (THEY ARE INDEPENDENT: EACH WRITES ITS OWN coll_batch ENTRY)
+    // Each batch records its buffers in lists of its own, joined in the order of the batches, so that the plan (and the
+    // buffers replayed for a count-parametric plan) does not depend on the threads. Replays run on one thread.
+    struct Planner {
+      std::function<void(int)> plan_batch;
+      std::atomic<int> next{0};
+      int numbatch;
+    };
+    static void* plan_thread(void *arg) {
+      Planner *planner = (Planner*) arg;
+      for(int batch = planner->next++; batch < planner->numbatch; batch = planner->next++)
+        planner->plan_batch(batch);
+      return NULL;
+    }
+    static void* plan_thread_gpu(void *arg) {
+      CommBench::setup_gpu();
+      return plan_thread(arg);
+    }
+    void plan_batches(int numbatch, std::function<void(int)> plan_batch) {
+      std::vector<std::pair<void*, size_t>> *record = buffer_record;
+      std::vector<std::pair<void*, size_t>> *scratch = buffer_scratch;
+      std::vector<std::vector<std::pair<void*, size_t>>> record_batch(numbatch);
+      std::vector<std::vector<std::pair<void*, size_t>>> scratch_batch(numbatch);
+      Planner planner;
+      planner.numbatch = numbatch;
+      planner.plan_batch = [&] (int batch) {
+        buffer_record = (record ? &record_batch[batch] : nullptr);
+        buffer_scratch = (scratch ? &scratch_batch[batch] : nullptr);
+        rank_load = (load_batch.size() ? &load_batch[batch] : nullptr);
+        plan_batch(batch);
+        rank_load = nullptr;
+      };
+      std::vector<pthread_t> thread(buffer_replay ? 0 : std::min(numthread, numbatch));
+      if(thread.size() > 1) {
+        for(auto &t : thread)
+          pthread_create(&t, NULL, plan_thread_gpu, &planner);
+        for(auto &t : thread)
+          pthread_join(t, NULL);
+      }
+      else
+        plan_thread(&planner);
+      buffer_record = record;
+      buffer_scratch = scratch;
+      for(int batch = 0; batch < numbatch; batch++) {
+        if(record)
+          record->insert(record->end(), record_batch[batch].begin(), record_batch[batch].end());
+        if(scratch)
+          scratch->insert(scratch->end(), scratch_batch[batch].begin(), scratch_batch[batch].end());
+      }
+    }
+
     // INITIALIZE BROADCAST AND REDUCTION TREES
-    void init(int numlevel, int groupsize[], CommBench::library lib[], int numstripe, int numbatch) {
+    void plan(int numlevel, int groupsize[], CommBench::library lib[], int numstripe[], int numbatch, size_t chunk, const Options &options) {
 
       if(myid == printid) {
         printf("NUMBER OF EPOCHS: %d\n", numepoch);
-        for(int epoch = 0; epoch < numepoch; epoch++)
-          printf("epoch %d: %zu bcast %zu reduction\n", epoch, bcast_epoch[epoch].size(), reduce_epoch[epoch].size());
+        for(int epoch = 0; epoch < numepoch; epoch++) {
+          printf("epoch %d: %zu bcast %zu reduction", epoch, bcast_epoch[epoch].size(), reduce_epoch[epoch].size());
+          if(bulk_epoch[epoch].size())
+            printf(" %zu bulk", bulk_epoch[epoch].size());
+          printf("\n");
+        }
         printf("Initialize HiCCL with %d levels\n", numlevel);
         for(int level = 0; level < numlevel; level++) {
           printf("level %d groupsize %d library: ", level, groupsize[level]);
@@ -17,62 +72,139 @@
         printf("\n");
       }
 
-      // ALLOCATE COMMAND BATCH
-      for(int batch = 0; batch < numbatch; batch++)
+      // ALLOCATE COMMAND BATCH (STAGGERED BY ONE STEP PER BATCH)
+      for(int batch = 0; batch < numbatch; batch++) {
         coll_batch.push_back(std::list<Coll<T>*>());
+        batchoffset.push_back(batch);
+      }
 
       // TEMP HIERARCHY FOR TREE
       std::vector<int> groupsize_temp(groupsize, groupsize + numlevel);
       groupsize_temp[0] = numproc;
+      // GROUP OF THE NEXT LEVEL THAT A STRIPED PRIMITIVE LEAVES (THE NODE OF numstripe PROCESSES AT LEVEL 0)
+      std::vector<int> groupsize_next(numlevel, 1);
+      groupsize_next[0] = numstripe[0];
+      for(int level = 1; level + 1 < numlevel; level++)
+        groupsize_next[level] = groupsize[level + 1];
 
       // FOR EACH EPOCH
+      proc_load.assign(balance ? numproc : 0, 0);
       for(int epoch = 0; epoch < numepoch; epoch++) {
+        // LOADS OF THE PROCESSES (BALANCED ACROSS THE EPOCH)
+        load_batch.assign(balance ? numbatch : 0, std::vector<size_t>(numproc, 0));
         // INIT BROADCAST
         std::vector<BROADCAST<T>> &bcastlist = bcast_epoch[epoch];
         if(bcastlist.size()) {
           // PARTITION INTO BATCHES
           std::vector<std::vector<BROADCAST<T>>> bcast_batch(numbatch);
-          partition(bcastlist, numbatch, bcast_batch);
+          partition(bcastlist, numbatch, bcast_batch, chunk, options.parametric);
           // FOR EACH BATCH
-          for(int batch = 0; batch < numbatch; batch++) {
-            // STRIPE BROADCAST PRIMITIVES
+          plan_batches(numbatch, [&] (int batch) {
+            // STRIPE BROADCAST PRIMITIVES (ACROSS NODES, THEN WITHIN EACH LEVEL WITH PARALLEL PATHS)
             std::vector<REDUCE<T>> split_list;
-            stripe(numstripe, bcast_batch[batch], split_list);
+            std::vector<BROADCAST<T>> stripe_list;
+            for(int level = 0; level < numlevel; level++)
+              if(level == 0 || numstripe[level] > 1)
+                stripe(numstripe[level], groupsize_temp[level], groupsize_next[level], bcast_batch[batch], stripe_list, split_list, options);
+            std::move(stripe_list.begin(), stripe_list.end(), std::back_inserter(bcast_batch[batch]));
 
             // APPLY REDUCE TREE TO ROOTS FOR STRIPING
-            std::vector<T*> recvbuff; // for memory recycling
+            std::vector<std::pair<T*, size_t>> recvbuff; // for memory recycling
             // reduce_tree(numlevel, groupsize_temp.data(), lib, split_list, numlevel - 1, coll_batch[batch], recvbuff, 0);
-            reduce_tree(1, groupsize_temp.data(), &lib[numlevel-1], split_list, 0, coll_batch[batch], recvbuff, 0);
+            size_t numcoll = coll_batch[batch].size();
+            reduce_tree(1, groupsize_temp.data(), &lib[numlevel-1], std::move(split_list), 0, coll_batch[batch], recvbuff, 0, options);
+            for(auto it = std::next(coll_batch[batch].begin(), numcoll); it != coll_batch[batch].end(); it++) {
+              (*it)->level = numlevel - 1; // striping takes place within the leaf level
+              (*it)->reduction = false; // and only copies
+            }
 
             // APPLY RING TO BRANCHES ACROSS NODES
             std::vector<BROADCAST<T>> bcast_intra; // for accumulating intra-node communications for tree (internally)
-            bcast_ring(groupsize[0], lib[0], bcast_batch[batch], bcast_intra, coll_batch[batch]);
+            bcast_ring(groupsize[0], lib[0], bcast_batch[batch], bcast_intra, coll_batch[batch], options.local);
 
             // APPLY TREE TO THE LEAVES WITHIN NODES
-            bcast_tree(numlevel, groupsize_temp.data(), lib, bcast_intra, 1, coll_batch[batch]);
-          }
+            bcast_tree(numlevel, groupsize_temp.data(), lib, std::move(bcast_intra), 1, coll_batch[batch], options.local);
+          });
         }
         // INIT REDUCTION
         std::vector<REDUCE<T>> &reducelist = reduce_epoch[epoch];
         if(reducelist.size()) {
           // PARTITION INTO BATCHES
           std::vector<std::vector<REDUCE<T>>> reduce_batch(numbatch);
-          partition(reducelist, numbatch, reduce_batch);
+          partition(reducelist, numbatch, reduce_batch, chunk, options.parametric);
           // FOR EACH BATCH
-          for(int batch = 0; batch < numbatch; batch++) {
-            // STRIPE REDUCTION
+          plan_batches(numbatch, [&] (int batch) {
+            // REPRODUCIBLE: CANONICAL TREE WITHOUT STRIPING AND RING
+            if(reproducible) {
+              reduce_canonical(numlevel, groupsize_temp.data(), lib, reduce_batch[batch], coll_batch[batch], options.local);
+              return;
+            }
+            // STRIPE REDUCTION (ACROSS NODES, THEN WITHIN EACH LEVEL WITH PARALLEL PATHS)
             std::vector<BROADCAST<T>> merge_list;
-            stripe(numstripe, reduce_batch[batch], merge_list);
+            std::vector<REDUCE<T>> stripe_list;
+            for(int level = 0; level < numlevel; level++)
+              if(level == 0 || numstripe[level] > 1)
+                stripe(numstripe[level], groupsize_temp[level], groupsize_next[level], reduce_batch[batch], stripe_list, merge_list, options);
+            std::move(stripe_list.begin(), stripe_list.end(), std::back_inserter(reduce_batch[batch]));
             // HIERARCHICAL REDUCTION RING + TREE
             std::vector<REDUCE<T>> reduce_intra; // for accumulating intra-node communications for tree (internally)
-            reduce_ring(numlevel, groupsize, lib, reduce_batch[batch], reduce_intra, coll_batch[batch]);
+            reduce_ring(numlevel, groupsize, lib, reduce_batch[batch], reduce_intra, coll_batch[batch], options);
             // COMPLETE STRIPING BY INTRA-NODE GATHER
-            bcast_tree(numlevel, groupsize_temp.data(), lib, merge_list, 1, coll_batch[batch]);
+            bcast_tree(numlevel, groupsize_temp.data(), lib, std::move(merge_list), 1, coll_batch[batch], options.local);
+          });
+        }
+        // INIT BULK PRIMITIVES (ROUTED BY THE HIERARCHY, WITHOUT STRIPING AND RING)
+        std::vector<BULK<T>> &bulklist = bulk_epoch[epoch];
+        if(bulklist.size()) {
+          std::vector<std::vector<BULK<T>>> bulk_batch(numbatch);
+          partition(bulklist, numbatch, bulk_batch, chunk, options.parametric);
+          plan_batches(numbatch, [&] (int batch) {
+            for(auto &bulk : bulk_batch[batch])
+              if(bulk.type == alltoall)
+                bulk_alltoall(numlevel, groupsize_temp.data(), lib, bulk, coll_batch[batch], aggregate, options.local);
+              else if(bulk.type == allgather)
+                bulk_allgather(numlevel, groupsize_temp.data(), lib, bulk, coll_batch[batch], options.local);
+              else
+                bulk_gather(numlevel, groupsize_temp.data(), lib, bulk, coll_batch[batch], options.local);
+          });
+        }
+        for(auto &load_proc : load_batch)
+          for(int p = 0; p < numproc; p++)
+            proc_load[p] += load_proc[p];
+      }
+      load_batch.clear();
+      // RE-CHUNK THE TRANSFERS OF EACH LEVEL TO ITS MTU
+      for(auto &coll_list : coll_batch)
+        for(auto &coll : coll_list)
+          if(coll->level > -1 && coll->level < mtu.size() && mtu[coll->level])
+            coll->rechunk(mtu_count(mtu[coll->level]));
+      // SPLIT THE STEPS WITH INCAST INTO ROUNDS OF AT MOST incast[level] SENDERS PER RECEIVER
+      if(incast.size()) {
+        int numsplit = 0;
+        int numround = 0;
+        int maxfanin = 0;
+        for(auto &coll_list : coll_batch) {
+          std::list<Coll<T>*> split_list;
+          for(auto &coll : coll_list) {
+            if(coll->level > -1 && coll->level < incast.size() && incast[coll->level]) {
+              int fanin;
+              std::vector<Coll<T>*> round = coll->incast(incast[coll->level], fanin);
+              maxfanin = std::max(maxfanin, fanin);
+              split_list.insert(split_list.end(), round.begin(), round.end());
+              if(round.size() > 1) {
+                numsplit++;
+                numround += round.size();
+                delete coll;
+              }
+            }
+            else
+              split_list.push_back(coll);
           }
+          coll_list.swap(split_list);
         }
+        if(myid == printid)
+          printf("incast: %d steps split into %d rounds (fan-in up to %d)\n", numsplit, numround, maxfanin);
       }
-      // IMPLEMENT WITH COMMBENCH
-      implement(coll_batch, command_batch, 1);
     }
 
 
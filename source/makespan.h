@@ -0,0 +1,176 @@
+
+  // PLACEMENT OF THE BATCH STEPS INTO PIPELINE STEPS
+  // staggered: batch i starts batchoffset[i] steps late, whatever the costs (default).
+  // makespan: list scheduling by estimated cost. The batches are placed one after the other, the steps of each into the
+  // pipeline steps (rows) that least increase the estimated makespan, so that short steps fill the bubbles beside long ones.
+  // A row takes as long as its slowest lane, and a lane as long as its latency plus the heaviest load (sends, receives and
+  // reduction inputs) of a single process. If the estimate is not shorter than staggered, the batches are staggered.
+  enum scheduler {staggered, makespan};
+
+  // COST MODEL OF THE LANES (e.g., FROM THE MEASUREMENTS OF Command::measure)
+  struct Cost {
+    double latency[CommBench::numlib]; // seconds per step
+    double bandwidth[CommBench::numlib]; // bytes per second
+    double compute = 2e11; // bytes of reduction input per second
+    Cost() {
+      for(int lib = 0; lib < CommBench::numlib; lib++) {
+        latency[lib] = 0;
+        bandwidth[lib] = 1e11;
+      }
+      latency[CommBench::IPC] = 2e-6;
+      latency[CommBench::IPC_get] = 2e-6;
+      latency[CommBench::MPI] = 5e-6;
+      bandwidth[CommBench::MPI] = 2.5e10;
+      latency[CommBench::XCCL] = 1e-5;
+      bandwidth[CommBench::XCCL] = 2.5e10;
+    }
+  };
+
+  template <typename T>
+  class Makespan {
+
+    public:
+
+    // LOAD OF A BATCH STEP: SECONDS PER LANE AND PROCESS
+    struct Load {
+      std::vector<std::map<int, double>> time;
+      std::vector<bool> busy;
+    };
+
+    private:
+
+    // PIPELINE STEP
+    struct Row {
+      std::vector<std::vector<double>> time; // per lane and process (allocated when the lane is used)
+      std::vector<double> heaviest; // per lane: load of the heaviest process
+      double duration = 0;
+    };
+
+    const Cost &cost;
+    const std::vector<int> &lib; // of the lanes
+    int numlane;
+    std::vector<Row> row;
+
+    void append() {
+      row.push_back(Row());
+      row.back().time.resize(numlane);
+      row.back().heaviest.resize(numlane, 0);
+    }
+
+    // DURATION OF ROW r WITH THE LOAD ADDED (r == row.size(): A NEW ROW)
+    double duration(int r, Load &load) {
+      double duration = (r < row.size() ? row[r].duration : 0);
+      for(int l = 0; l < numlane; l++)
+        if(load.busy[l]) {
+          bool used = (r < row.size() && row[r].time[l].size());
+          double heaviest = (used ? row[r].heaviest[l] : 0);
+          for(auto &p : load.time[l])
+            heaviest = std::max(heaviest, (used ? row[r].time[l][p.first] : 0) + p.second);
+          duration = std::max(duration, cost.latency[lib[l]] + heaviest);
+        }
+      return duration;
+    }
+
+    void add(int r, Load &load) {
+      Row &target = row[r];
+      for(int l = 0; l < numlane; l++)
+        if(load.busy[l]) {
+          if(target.time[l].empty())
+            target.time[l].resize(numproc, 0);
+          for(auto &p : load.time[l]) {
+            target.time[l][p.first] += p.second;
+            target.heaviest[l] = std::max(target.heaviest[l], target.time[l][p.first]);
+          }
+          target.duration = std::max(target.duration, cost.latency[lib[l]] + target.heaviest[l]);
+        }
+    }
+
+    public:
+
+    Makespan(const Cost &cost, const std::vector<int> &lib) : cost(cost), lib(lib), numlane(lib.size()) {}
+
+    // LOAD OF A COLL WITH THE LANES OF ITS TRANSFERS AND OF ITS COMPUTATION (AS IN implement)
+    Load load(Coll<T> *coll, const std::vector<int> &lane_comm, int lane_compute) {
+      Load load;
+      load.time.resize(numlane);
+      load.busy.resize(numlane, false);
+      for(int i = 0; i < coll->numcomm; i++) {
+        int l = lane_comm[i];
+        double time = coll->count[i] * sizeof(T) / cost.bandwidth[lib[l]];
+        load.busy[l] = true;
+        load.time[l][coll->sendid[i]] += time;
+        if(coll->recvid[i] != coll->sendid[i])
+          load.time[l][coll->recvid[i]] += time;
+      }
+      for(int i = 0; i < coll->numcompute; i++) {
+        load.busy[lane_compute] = true;
+        load.time[lane_compute][coll->compid[i]] += coll->inputbuf[i].size() * coll->numreduce[i] * sizeof(T) / cost.compute;
+      }
+      return load;
+    }
+
+    // ROWS OF THE STEPS OF A BATCH THAT LEAST INCREASE THE MAKESPAN, AFTER THE BATCHES PLACED BEFORE
+    // The increase is the sum of the increases of the rows, so the best rows (strictly increasing) follow by dynamic
+    // programming: cost[k][r] is the least increase for steps 0..k with step k in row r (the earliest rows on ties).
+    std::vector<int> place(std::vector<Load> &step) {
+      int numstep = step.size();
+      int numrow = row.size() + numstep;
+      std::vector<int> rows(numstep);
+      if(numstep == 0)
+        return rows;
+      const double inf = std::numeric_limits<double>::infinity();
+      std::vector<std::vector<double>> cost(numstep, std::vector<double>(numrow, inf));
+      std::vector<std::vector<int>> from(numstep, std::vector<int>(numrow, -1));
+      for(int k = 0; k < numstep; k++) {
+        double best = (k ? inf : 0);
+        int arg = -1;
+        for(int r = k; r < numrow; r++) {
+          if(k && cost[k - 1][r - 1] < best) {
+            best = cost[k - 1][r - 1];
+            arg = r - 1;
+          }
+          cost[k][r] = best + duration(r, step[k]) - (r < row.size() ? row[r].duration : 0);
+          from[k][r] = arg;
+        }
+      }
+      int last = numstep - 1;
+      for(int r = last; r < numrow; r++)
+        if(cost[numstep - 1][r] < cost[numstep - 1][last])
+          last = r;
+      for(int k = numstep - 1; k > -1; k--) {
+        rows[k] = last;
+        last = from[k][last];
+      }
+      place(step, rows);
+      return rows;
+    }
+
+    // ROWS GIVEN (e.g., STAGGERED)
+    void place(std::vector<Load> &step, const std::vector<int> &rows) {
+      for(int k = 0; k < step.size(); k++) {
+        while(row.size() <= rows[k])
+          append();
+        add(rows[k], step[k]);
+      }
+    }
+
+    // ESTIMATED MAKESPAN AND BUBBLE FRACTION (IDLE SHARE OF THE LANES)
+    double total() {
+      double total = 0;
+      for(auto &r : row)
+        total += r.duration;
+      return total;
+    }
+    double bubble() {
+      double busy = 0;
+      for(auto &r : row)
+        for(int l = 0; l < numlane; l++)
+          if(r.time[l].size())
+            busy += cost.latency[lib[l]] + r.heaviest[l];
+      double span = total() * numlane;
+      return span > 0 ? 1 - busy / span : 0;
+    }
+    int numrow() {
+      return row.size();
+    }
+  };
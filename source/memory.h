@@ -0,0 +1,50 @@
+
+  // INTERMEDIATE BUFFERS OF THE PLANNER
+  // Count-parametric plans record the buffers of the maximum-size plan and replay them (in the same order) for smaller counts.
+  // Planner threads record into lists of their own batch (thread_local), which are joined in the order of the batches.
+  static thread_local std::vector<std::pair<void*, size_t>> *buffer_record = nullptr;
+  static std::vector<std::pair<void*, size_t>> *buffer_replay = nullptr;
+  static size_t buffer_next = 0;
+  static thread_local std::vector<std::pair<void*, size_t>> *buffer_scratch = nullptr; // all buffers handed out (for the schedule)
+  static pthread_mutex_t buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+  static bool buffer_dry = false; // hand out no memory (planner benchmark)
+
+  template <typename T>
+  void allocate_buffer(T *&buffer, size_t count) {
+    if(buffer_dry) {
+      buffer = nullptr;
+      return;
+    }
+    if(buffer_replay) {
+      if(buffer_next < buffer_replay->size() && (*buffer_replay)[buffer_next].second >= count * sizeof(T)) {
+        buffer = (T*) (*buffer_replay)[buffer_next].first;
+        buffer_next++;
+        if(buffer_scratch)
+          buffer_scratch->push_back(std::make_pair((void*) buffer, count * sizeof(T)));
+        return;
+      }
+      printf("ERROR!!! myid %d replay buffer %zu does not fit count %zu, allocating.\n", myid, buffer_next, count);
+      buffer_next++;
+    }
+    pthread_mutex_lock(&buffer_mutex);
+    CommBench::allocate(buffer, count);
+    pthread_mutex_unlock(&buffer_mutex);
+    buffsize += count;
+    if(buffer_record)
+      buffer_record->push_back(std::make_pair((void*) buffer, count * sizeof(T)));
+    if(buffer_scratch)
+      buffer_scratch->push_back(std::make_pair((void*) buffer, count * sizeof(T)));
+  }
+
+  // RESIDENT MEMORY OF THIS PROCESS IN BYTES (0 WHERE /proc IS NOT AVAILABLE)
+  inline size_t resident_bytes() {
+    size_t pages = 0;
+    size_t resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if(file) {
+      if(fscanf(file, "%zu %zu", &pages, &resident) != 2)
+        resident = 0;
+      fclose(file);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+  }
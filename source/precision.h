@@ -0,0 +1,88 @@
+
+  // HOST HALF-PRECISION TYPES
+  // Storage is 16 bits; arithmetic converts to float. Conversions round to the nearest even.
+
+  inline uint16_t float_to_bfloat16(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(float));
+    if((bits & 0x7FFFFFFF) > 0x7F800000)
+      return (bits >> 16) | 0x0040; // quiet NaN
+    bits += 0x7FFF + ((bits >> 16) & 1); // round to nearest even
+    return bits >> 16;
+  }
+  inline float bfloat16_to_float(uint16_t x) {
+    uint32_t bits = (uint32_t) x << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(float));
+    return f;
+  }
+
+  inline uint16_t float_to_half(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(float));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+    if(magnitude > 0x7F800000)
+      return sign | 0x7E00; // NaN
+    if(magnitude >= 0x477FF000)
+      return sign | 0x7C00; // overflow to infinity (65520 and above)
+    if(magnitude < 0x38800000) { // subnormal (below 2^-14): multiple of 2^-24
+      float f;
+      memcpy(&f, &magnitude, sizeof(float));
+      return sign | (uint16_t) std::nearbyint(f * 16777216.f);
+    }
+    uint32_t h = (magnitude - 0x38000000) >> 13; // rebias exponent from 127 to 15
+    uint32_t remainder = magnitude & 0x1FFF;
+    if(remainder > 0x1000 || (remainder == 0x1000 && (h & 1)))
+      h++;
+    return sign | h;
+  }
+  inline float half_to_float(uint16_t x) {
+    uint32_t sign = (uint32_t) (x & 0x8000) << 16;
+    uint32_t exponent = (x >> 10) & 0x1F;
+    uint32_t mantissa = x & 0x3FF;
+    uint32_t bits;
+    if(exponent == 0) {
+      float f = mantissa / 16777216.f;
+      return (sign ? -f : f);
+    }
+    if(exponent == 31)
+      bits = sign | 0x7F800000 | (mantissa << 13);
+    else
+      bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float f;
+    memcpy(&f, &bits, sizeof(float));
+    return f;
+  }
+
+  struct bf16 {
+    uint16_t bits;
+    bf16() = default;
+    bf16(float x) : bits(float_to_bfloat16(x)) {}
+    operator float() const { return bfloat16_to_float(bits); }
+    bf16 &operator+=(float x) { return *this = bf16(float(*this) + x); }
+  };
+
+  struct fp16 {
+    uint16_t bits;
+    fp16() = default;
+    fp16(float x) : bits(float_to_half(x)) {}
+    operator float() const { return half_to_float(bits); }
+    fp16 &operator+=(float x) { return *this = fp16(float(*this) + x); }
+  };
+
+  // ACCUMULATOR OF REDUCTIONS ON TYPE T (DEFAULT OF THE SECOND TEMPLATE PARAMETER OF Comm)
+  // e.g., Comm<bf16> accumulates in float, Comm<float, double> accumulates in double.
+  template <typename T>
+  struct accumulator {
+    typedef T type;
+  };
+  template <> struct accumulator<bf16> { typedef float type; };
+  template <> struct accumulator<fp16> { typedef float type; };
+#ifdef PORT_CUDA
+  template <> struct accumulator<__half> { typedef float type; };
+  template <> struct accumulator<__nv_bfloat16> { typedef float type; };
+#elif defined PORT_HIP
+  template <> struct accumulator<__half> { typedef float type; };
+  template <> struct accumulator<__hip_bfloat16> { typedef float type; };
+#endif
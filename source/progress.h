@@ -0,0 +1,85 @@
+
+  // PROGRESS MODES OF run()
+  // ordered: start all lanes, wait lanes in reverse order, then computations (one step of all lanes at a time).
+  // polling: each lane advances independently; a step starts when the steps it depends on completed (see Command),
+  // a computation starts as soon as the communications it depends on arrived.
+  // threaded: as polling, but each lane runs on its own thread that blocks on its own communication and computation.
+  enum progress {ordered, polling, threaded};
+
+  // PERSISTENT THREAD OF A LANE (OPTIONALLY PINNED TO A CORE) RUNNING POSTED TASKS, POLLED WITH done()
+  // CommBench offers blocking wait() only, so a polling loop hands each wait to the thread of its lane;
+  // threaded progress hands the whole lane.
+  class Worker {
+
+    pthread_t thread;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+    std::function<void()> task;
+    bool posted = false;
+    bool quit = false;
+    std::atomic<bool> finished{true};
+
+    static void* loop(void *arg) {
+      Worker *worker = (Worker*) arg;
+      CommBench::setup_gpu();
+      pthread_mutex_lock(&worker->mutex);
+      while(true) {
+        while(!worker->posted && !worker->quit)
+          pthread_cond_wait(&worker->cond, &worker->mutex);
+        if(worker->quit)
+          break;
+        std::function<void()> task = worker->task;
+        worker->posted = false;
+        pthread_mutex_unlock(&worker->mutex);
+        task();
+        worker->finished = true;
+        pthread_mutex_lock(&worker->mutex);
+      }
+      pthread_mutex_unlock(&worker->mutex);
+      return NULL;
+    }
+
+    public:
+
+    Worker(int core = -1) {
+      pthread_create(&thread, NULL, loop, this);
+      if(core > -1) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(core, &cpuset);
+        if(pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset))
+          printf("HiCCL: myid %d cannot pin lane thread to core %d\n", myid, core);
+      }
+    }
+    ~Worker() {
+      pthread_mutex_lock(&mutex);
+      quit = true;
+      pthread_cond_signal(&cond);
+      pthread_mutex_unlock(&mutex);
+      pthread_join(thread, NULL);
+    }
+
+    void post(std::function<void()> task) {
+      finished = false;
+      pthread_mutex_lock(&mutex);
+      this->task = task;
+      posted = true;
+      pthread_cond_signal(&cond);
+      pthread_mutex_unlock(&mutex);
+    }
+    bool done() {
+      return finished;
+    }
+    void wait() {
+      while(!finished)
+        sched_yield();
+    }
+  };
+
+  // TRUE IF ALL LANES IN mask REACHED count
+  inline bool ready(unsigned mask, std::vector<int> &counter, int count) {
+    for(int lane = 0; lane < counter.size(); lane++)
+      if((mask & (1u << lane)) && counter[lane] < count)
+        return false;
+    return true;
+  }
@@ -0,0 +1,175 @@
+
+  // SET OF PROCESSES AS RUNS OF CONSECUTIVE RANKS (IN ORDER OF INSERTION, DUPLICATES ALLOWED)
+  // HiCCL::all and HiCCL::others take one and two runs whatever numproc, and the processes of a group are selected run
+  // by run. Up to two runs are stored in place, so that most primitives of the planner do not allocate.
+  class Ranks {
+
+    struct Run {
+      int begin;
+      int end;
+    };
+    Run run_local[2];
+    std::vector<Run> run_heap; // all runs when there are more than two
+    int numrun = 0;
+    int numrank = 0;
+
+    Run *data() {
+      return numrun > 2 ? run_heap.data() : run_local;
+    }
+    const Run *data() const {
+      return numrun > 2 ? run_heap.data() : run_local;
+    }
+
+    public:
+
+    class iterator {
+      const Run *run;
+      const Run *last;
+      int rank;
+      public:
+      iterator(const Run *run, const Run *last) : run(run), last(last), rank(run < last ? run->begin : 0) {}
+      const int &operator*() const { return rank; }
+      iterator &operator++() {
+        if(++rank == run->end) {
+          run++;
+          rank = (run < last ? run->begin : 0);
+        }
+        return *this;
+      }
+      bool operator==(const iterator &other) const { return run == other.run && rank == other.rank; }
+      bool operator!=(const iterator &other) const { return !(*this == other); }
+    };
+
+    Ranks() {}
+    Ranks(int begin, int end) {
+      push_back(begin, end);
+    }
+    Ranks(const std::vector<int> &ranks) {
+      for(auto &rank : ranks)
+        push_back(rank);
+    }
+
+    // APPEND RANKS begin ... end - 1 (MERGED WITH THE LAST RUN IF ADJACENT)
+    void push_back(int begin, int end) {
+      if(begin >= end)
+        return;
+      numrank += end - begin;
+      if(numrun && data()[numrun - 1].end == begin) {
+        data()[numrun - 1].end = end;
+        return;
+      }
+      if(numrun == 2)
+        run_heap.assign(run_local, run_local + 2);
+      if(numrun < 2)
+        run_local[numrun] = {begin, end};
+      else
+        run_heap.push_back({begin, end});
+      numrun++;
+    }
+    void push_back(int rank) {
+      push_back(rank, rank + 1);
+    }
+    void push_back(const Ranks &ranks) {
+      for(int r = 0; r < ranks.numrun; r++)
+        push_back(ranks.data()[r].begin, ranks.data()[r].end);
+    }
+
+    size_t size() const { return numrank; }
+    bool empty() const { return numrank == 0; }
+    int runs() const { return numrun; }
+    iterator begin() const { return iterator(data(), data() + numrun); }
+    iterator end() const { return iterator(data() + numrun, data() + numrun); }
+
+    int operator[](size_t i) const {
+      for(int r = 0; r < numrun; r++) {
+        size_t length = data()[r].end - data()[r].begin;
+        if(i < length)
+          return data()[r].begin + i;
+        i -= length;
+      }
+      return -1;
+    }
+
+    // NUMBER OF RANKS IN begin ... end - 1
+    size_t count(int begin, int end) const {
+      size_t count = 0;
+      for(int r = 0; r < numrun; r++)
+        count += std::max(0, std::min(end, data()[r].end) - std::max(begin, data()[r].begin));
+      return count;
+    }
+    // RANKS IN begin ... end - 1 (IN ORDER)
+    Ranks select(int begin, int end) const {
+      Ranks ranks;
+      for(int r = 0; r < numrun; r++)
+        ranks.push_back(std::max(begin, data()[r].begin), std::min(end, data()[r].end));
+      return ranks;
+    }
+    // RANKS OUTSIDE begin ... end - 1 (IN ORDER)
+    Ranks exclude(int begin, int end) const {
+      Ranks ranks;
+      for(int r = 0; r < numrun; r++) {
+        ranks.push_back(data()[r].begin, std::min(begin, data()[r].end));
+        ranks.push_back(std::max(end, data()[r].begin), data()[r].end);
+      }
+      return ranks;
+    }
+    // REMOVE THE FIRST OCCURENCE OF rank, RETURNS false IF THERE IS NONE
+    bool erase(int rank) {
+      Ranks ranks;
+      bool found = false;
+      for(int r = 0; r < numrun; r++) {
+        const Run &run = data()[r];
+        if(!found && rank >= run.begin && rank < run.end) {
+          ranks.push_back(run.begin, rank);
+          ranks.push_back(rank + 1, run.end);
+          found = true;
+        }
+        else
+          ranks.push_back(run.begin, run.end);
+      }
+      if(found)
+        *this = std::move(ranks);
+      return found;
+    }
+    // GROUPS OF groupsize PROCESSES WITH ANY OF THE RANKS (ASCENDING)
+    void groups(int groupsize, std::vector<int> &group) const {
+      group.clear();
+      for(int r = 0; r < numrun; r++)
+        for(int g = data()[r].begin / groupsize; g <= (data()[r].end - 1) / groupsize; g++)
+          group.push_back(g);
+      if(numrun > 1) {
+        std::sort(group.begin(), group.end());
+        group.erase(std::unique(group.begin(), group.end()), group.end());
+      }
+    }
+    std::vector<int> list() const {
+      std::vector<int> list;
+      list.reserve(numrank);
+      for(auto &rank : *this)
+        list.push_back(rank);
+      return list;
+    }
+  };
+
+  // LOAD-BALANCED REDUCERS AND FORWARDERS
+  // By default, the trees and the ring pick the process of a group that reduces (or forwards) a primitive by the local index of
+  // its receiver (or sender), which concentrates the work of uneven compositions on a few processes. When balanced, they pick
+  // among the senders (or receivers) of the primitive in the group, which need no extra copy, the one with the fewest bytes
+  // assigned so far (received and reduced, counted by Coll::add). Each batch keeps its own loads, so that the plan does not
+  // depend on the planner threads.
+  static bool balanced = false;
+  static thread_local std::vector<size_t> *rank_load = nullptr; // of the batch being planned (nullptr: not counted)
+
+  inline int select_rank(int preferred, const Ranks &candidate) {
+    if(!balanced || rank_load == nullptr || candidate.empty())
+      return preferred;
+    size_t min = std::numeric_limits<size_t>::max();
+    for(auto &rank : candidate)
+      min = std::min(min, (*rank_load)[rank]);
+    if(candidate.count(preferred, preferred + 1) && (*rank_load)[preferred] == min)
+      return preferred;
+    for(auto &rank : candidate)
+      if((*rank_load)[rank] == min)
+        return rank;
+    return preferred;
+  }
@@ -6,7 +6,7 @@
     T* recvbuf;
     size_t recvoffset;
     size_t count;
-    std::vector<int> sendids;
+    Ranks sendids;
     int recvid;
 
     void report() {
@@ -48,26 +48,63 @@
       }
     }
 
-    REDUCE(T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count, std::vector<int> &sendids, int recvid)
-    : sendbuf(sendbuf), sendoffset(sendoffset), recvbuf(recvbuf), recvoffset(recvoffset), count(count), sendids(sendids), recvid(recvid) { }
+    REDUCE(T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count, Ranks sendids, int recvid)
+    : sendbuf(sendbuf), sendoffset(sendoffset), recvbuf(recvbuf), recvoffset(recvoffset), count(count), sendids(std::move(sendids)), recvid(recvid) { }
 
     REDUCE(T *sendbuf, size_t sendoffset, T *recvbuf, size_t recvoffset, size_t count, int sendid, int recvid) : sendbuf(sendbuf), sendoffset(sendoffset), recvbuf(recvbuf), recvoffset(recvoffset), count(count), recvid(recvid) {
-      for(int i = 0; i < numproc; i++) {
-        if(sendid == numproc)
-          sendids.push_back(i);
-        else if(sendid == -1) {
-          if(i != recvid)
-            sendids.push_back(i);
-        }
-        else
-          if(i == sendid)
-            sendids.push_back(i);
+      if(sendid == numproc)
+        sendids.push_back(0, numproc);
+      else if(sendid == -1) {
+        sendids.push_back(0, recvid);
+        sendids.push_back(recvid + 1, numproc);
       }
+      else if(sendid > -1 && sendid < numproc)
+        sendids.push_back(sendid);
     }
   };
 
+  // STREAMING RECEIVE-REDUCE
+  // Each remote input arrives in streaming pieces through two scratch buffers of one piece each (instead of a buffer of
+  // count per input), and is added to the output as it lands. Coll u of coll_stream carries the transfer of piece u and
+  // the addition of piece u - 1 (pipelined), so the arithmetic overlaps the remaining transfers. The first input lands
+  // in the output directly unless the receiver has a local input; coll_stream[0] is the coll of the level.
+  template <typename T>
+  void reduce_stream(T *sendbuf, size_t sendoffset, Ranks &sendids, int recvid, bool local, T *localbuf, T *outputbuf, size_t count, std::vector<Coll<T>*> &coll_stream, const Options &options) {
+    int streaming = options.streaming;
+    size_t piece = count / streaming + (count % streaming ? 1 : 0);
+    T *scratch[2];
+    if(myid == recvid)
+      for(int s = 0; s < 2; s++)
+        allocate_buffer(scratch[s], piece);
+    int u = 0;
+    int in = 0;
+    for(auto &sendid : sendids) {
+      size_t offset = 0;
+      for(int p = 0; p < streaming; p++) {
+        size_t size = count / streaming + (p < count % streaming ? 1 : 0);
+        if(size == 0 && !options.parametric)
+          break;
+        while(coll_stream.size() < u + 2) {
+          coll_stream.push_back(new Coll<T>(coll_stream[0]->lib, coll_stream[0]->level, options.local));
+          coll_stream.back()->reduction = true;
+          coll_stream.back()->pipelined = true;
+        }
+        if(in == 0 && !local)
+          coll_stream[u]->add(sendbuf, sendoffset + offset, outputbuf, offset, size, sendid, recvid);
+        else {
+          coll_stream[u]->add(sendbuf, sendoffset + offset, scratch[u % 2], 0, size, sendid, recvid);
+          std::vector<T*> inputbuf = {(in == 0 ? localbuf : outputbuf) + offset, scratch[u % 2]};
+          coll_stream[u + 1]->add(inputbuf, outputbuf + offset, size, recvid);
+        }
+        offset += size;
+        u++;
+      }
+      in++;
+    }
+  }
+
   template <typename T>
-  void reduce_tree(int numlevel, int groupsize[], CommBench::library lib[], std::vector<REDUCE<T>> reducelist, int level, std::list<Coll<T>*> &coll_list, std::vector<T*> &recvbuf_ptr, int numrecvbuf) {
+  void reduce_tree(int numlevel, int groupsize[], CommBench::library lib[], std::vector<REDUCE<T>> reducelist, int level, std::list<Coll<T>*> &coll_list, std::vector<std::pair<T*, size_t>> &recvbuf_ptr, int numrecvbuf, const Options &options) {
 
     if(numproc != groupsize[0]) {
       printf("ERROR!!! groupsize[0] must be equal to numproc.\n");
@@ -80,29 +117,28 @@
     if(level == -1)
       return;
    
-    Coll<T> *coll_temp = new Coll<T>(lib[level]); 
+    Coll<T> *coll_temp = new Coll<T>(lib[level], level, options.local);
+    coll_temp->reduction = true;
+    std::vector<Coll<T>*> coll_stream = {coll_temp};
 
     std::vector<REDUCE<T>> reducelist_new;
 
-    int numgroup = numproc / groupsize[level];
-
     // if(printid == printid) {
-    //  printf("level %d groupsize %d numgroup %d\n", level, groupsize[level], numgroup);
+    //  printf("level %d groupsize %d numgroup %d\n", level, groupsize[level], numproc / groupsize[level]);
     // }
     // for(auto &reduce : reducelist)
     //   reduce.report();
 
     {
-      for(auto reduce : reducelist) {
-        std::vector<int> sendids_new;
-        std::vector<T*> sendbuf_new;
-        std::vector<size_t> sendoffset_new;
+      std::vector<int> group;
+      for(auto &reduce : reducelist) {
+        Ranks sendids_new;
+        T *sendbuf_new;
+        size_t sendoffset_new;
         // int recvgroup = reduce.recvid / groupsize[level];
-        for(int sendgroup = 0; sendgroup < numgroup; sendgroup++) {
-          std::vector<int> sendids;
-          for(auto &sendid : reduce.sendids)
-            if(sendid / groupsize[level] == sendgroup)
-              sendids.push_back(sendid);
+        reduce.sendids.groups(groupsize[level], group);
+        for(auto &sendgroup : group) {
+          Ranks sendids = reduce.sendids.select(sendgroup * groupsize[level], (sendgroup + 1) * groupsize[level]);
           if(sendids.size()) {
             /*if(printid == printid) {
               printf("recvgroup: %d recvid: %d sendgroup: %d sendids: ", recvgroup, reduce.recvid, sendgroup);
@@ -111,6 +147,8 @@
               printf("\n");
             }*/
             int recvid = sendgroup * groupsize[level] + reduce.recvid % groupsize[level];
+            if(recvid != reduce.recvid)
+              recvid = select_rank(recvid, sendids);
             T* outputbuf;
             size_t outputoffset;
             if(recvid == reduce.recvid) {
@@ -124,22 +162,34 @@
 	    }
 	    else {
               if(myid == recvid) {
-                CommBench::allocate(outputbuf, reduce.count);
+                allocate_buffer(outputbuf, reduce.count);
                 outputoffset = 0;
-                buffsize += reduce.count;
               }
               // if(printid == printid)
               //    printf("^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ proc %d send malloc %zu\n", recvid, reduce.count * sizeof(T));
             }
-            if(sendids.size() > 1) {
+            if(sendids.size() > 1 && options.streaming) {
+              Ranks sendids_remote;
+              bool local = false;
+              for(auto &sendid : sendids)
+                if(sendid != recvid)
+                  sendids_remote.push_back(sendid);
+                else
+                  local = true;
+              reduce_stream(reduce.sendbuf, reduce.sendoffset, sendids_remote, recvid, local, reduce.sendbuf + reduce.sendoffset, outputbuf + outputoffset, reduce.count, coll_stream, options);
+            }
+            else if(sendids.size() > 1) {
               std::vector<T*> inputbuf;
               for(auto &sendid : sendids) {
                 if(sendid != recvid) {
                   T *recvbuf;
                   if(numrecvbuf < recvbuf_ptr.size()) {
                     if(myid == recvid) {
-                      recvbuf = recvbuf_ptr[numrecvbuf]; // recycle memory
-                      recycle += reduce.count;
+                      if(recvbuf_ptr[numrecvbuf].second < reduce.count) // weighted stripes differ in size
+                        allocate_buffer(recvbuf_ptr[numrecvbuf].first, recvbuf_ptr[numrecvbuf].second = reduce.count);
+                      else
+                        recycle += reduce.count;
+                      recvbuf = recvbuf_ptr[numrecvbuf].first; // recycle memory
                       numrecvbuf++;
                     }
                     // if(myid == printid)
@@ -148,9 +198,8 @@
                   else
                   {
                     if(myid == recvid) {
-                      CommBench::allocate(recvbuf, reduce.count);
-                      recvbuf_ptr.push_back(recvbuf);
-                      buffsize += reduce.count;
+                      allocate_buffer(recvbuf, reduce.count);
+                      recvbuf_ptr.push_back(std::make_pair(recvbuf, reduce.count));
                       numrecvbuf++;
                     }
                     if(myid == numproc)
@@ -185,33 +234,28 @@
               }
             }
             sendids_new.push_back(recvid);
-            sendbuf_new.push_back(outputbuf);
-            sendoffset_new.push_back(outputoffset);
-          }
-        }
-        if(sendids_new.size()) {
-          T *sendbuf;
-          size_t sendoffset;
-          for(int i = 0; i < sendids_new.size(); i++)
-            if(myid == sendids_new[i]) {
-              sendbuf = sendbuf_new[i];
-              sendoffset = sendoffset_new[i];
+            if(myid == recvid) {
+              sendbuf_new = outputbuf;
+              sendoffset_new = outputoffset;
             }
-          reducelist_new.push_back(REDUCE<T>(sendbuf, sendoffset, reduce.recvbuf, reduce.recvoffset, reduce.count, sendids_new, reduce.recvid));
+          }
         }
+        if(sendids_new.size())
+          reducelist_new.push_back(REDUCE<T>(sendbuf_new, sendoffset_new, reduce.recvbuf, reduce.recvoffset, reduce.count, std::move(sendids_new), reduce.recvid));
       }
     }
     // ADD COMMUNICATION FOLLOWED BY COMPUTE (IF ANY) OTHERWISE CLEAR MEMORY
-    if(coll_temp->numcomm + coll_temp->numcompute)
-      coll_list.push_back(coll_temp);
-    else
-      delete coll_temp;
+    for(auto &coll : coll_stream)
+      if(coll->numcomm_all + coll->numcompute_all)
+        coll_list.push_back(coll);
+      else
+        delete coll;
 
-    reduce_tree(numlevel, groupsize, lib, reducelist_new, level - 1, coll_list, recvbuf_ptr, 0);
+    reduce_tree(numlevel, groupsize, lib, std::move(reducelist_new), level - 1, coll_list, recvbuf_ptr, 0, options);
   }
 
   template<typename T>
-  void reduce_ring(int numlevel, int groupsize[], CommBench::library lib[], std::vector<REDUCE<T>> &reducelist, std::vector<REDUCE<T>> &reducelist_intra, std::list<Coll<T>*> &coll_list) {
+  void reduce_ring(int numlevel, int groupsize[], CommBench::library lib[], std::vector<REDUCE<T>> &reducelist, std::vector<REDUCE<T>> &reducelist_intra, std::list<Coll<T>*> &coll_list, const Options &options) {
 
     //if(printid == printid)
    //   printf("number of original reductions %ld\n", reducelist.size());
@@ -219,7 +263,9 @@
     // std::vector<REDUCE<T>> reducelist_intra;
     std::vector<REDUCE<T>> reducelist_extra;
 
-    Coll<T> *coll_temp = new Coll<T>(lib[0]);
+    Coll<T> *coll_temp = new Coll<T>(lib[0], 0, options.local);
+    coll_temp->reduction = true;
+    std::vector<Coll<T>*> coll_stream = {coll_temp};
 
     //if(printid == printid)
     //  printf("number of original reductions %ld\n", reducelist.size());
@@ -227,62 +273,43 @@
       //if(printid == printid)
       //  printf("reduce recvid: %d numsend: %ld\n", reduce.recvid, reduce.sendids.size());
       int recvnode = reduce.recvid / groupsize[0];
-      std::vector<int> sendids_intra;
-      std::vector<int> sendids_extra;
-      for(auto &sendid : reduce.sendids) {
-        int sendnode = sendid / groupsize[0];
-        if(sendnode == recvnode)
-          sendids_intra.push_back(sendid);
-        else
-          sendids_extra.push_back(sendid);
-      }
+      Ranks sendids_intra = reduce.sendids.select(recvnode * groupsize[0], (recvnode + 1) * groupsize[0]);
       //if(printid == printid)
-      //  printf("recvid %d numsend %ld sendids_intra: %zu sendids_extra: %zu\n", reduce.recvid, reduce.sendids.size(), sendids_intra.size(), sendids_extra.size());
-      if(sendids_extra.size()) {
+      //  printf("recvid %d numsend %ld sendids_intra: %zu\n", reduce.recvid, reduce.sendids.size(), sendids_intra.size());
+      if(sendids_intra.size() < reduce.sendids.size()) {
         int numnode = numproc / groupsize[0];
         int sendnode = (numnode + recvnode + 1) % numnode;
-        std::vector<std::vector<int>> sendids(numnode);
-        for(auto &sendid : reduce.sendids)
-          sendids[sendid / groupsize[0]].push_back(sendid);
-        int sendid = sendnode * groupsize[0] + reduce.recvid % groupsize[0];
-        /*if(printid == printid) {
-          printf("****************** recvnode %d recvid %d sendnode %d sendid %d\n", recvnode, reduce.recvid, sendnode, sendid);
-          for(int node = 0; node < numnode; node++) {
-            printf("for node %d / %d: ", node, numnode);
-            for(auto &sendid : sendids[node])
-              printf("%d ", sendid);
-            printf("\n");
-          }
-        }*/
+        Ranks sendids_send = reduce.sendids.select(sendnode * groupsize[0], (sendnode + 1) * groupsize[0]);
+        int sendid = select_rank(sendnode * groupsize[0] + reduce.recvid % groupsize[0], sendids_send);
         // FOR SENDING NODE
         T *sendbuf;
         size_t sendoffset;
         bool sendreuse = false;
-        if(sendids[sendnode].size() == 1)
-          if(sendids[sendnode][0] == sendid) {
+        if(sendids_send.size() == 1)
+          if(sendids_send[0] == sendid) {
             sendbuf = reduce.sendbuf;
             sendoffset = reduce.sendoffset;
             sendreuse = true;
-            sendids[sendnode].clear();
 	    reuse += reduce.count;
             //if(printid == printid)
             //  printf("proc %d reuse %ld\n", sendid, reduce.count);
           }
         if(!sendreuse) {
 	  if(myid == sendid) {
-            CommBench::allocate(sendbuf, reduce.count);
+            allocate_buffer(sendbuf, reduce.count);
             sendoffset = 0;
-            buffsize += reduce.count;
           }
           //if(printid == printid)
           //  printf("proc %d allocate %ld\n", sendid, reduce.count);
         }
-        std::vector<int> sendids_extra;
-        for(int node = 0; node < numnode; node++)
-          if(node != recvnode)
-            for(auto &sendid: sendids[node])
-              sendids_extra.push_back(sendid);
-        reducelist_extra.push_back(REDUCE<T>(reduce.sendbuf, reduce.sendoffset, sendbuf, sendoffset, reduce.count, sendids_extra, sendid));
+        // SENDERS OF THE OTHER NODES IN ORDER OF THE NODES (BUT THE REUSED ONE)
+        Ranks sendids_extra;
+        std::vector<int> node;
+        reduce.sendids.groups(groupsize[0], node);
+        for(auto &n : node)
+          if(n != recvnode && !(n == sendnode && sendreuse))
+            sendids_extra.push_back(reduce.sendids.select(n * groupsize[0], (n + 1) * groupsize[0]));
+        reducelist_extra.push_back(REDUCE<T>(reduce.sendbuf, reduce.sendoffset, sendbuf, sendoffset, reduce.count, std::move(sendids_extra), sendid));
         //if(printid == printid)
         //  printf("recvid %d sendids_intra: %zu sendids_extra: %zu\n", reduce.recvid, sendids_intra.size(), sendids_extra.size());
         // FOR RECIEVING NODE
@@ -293,14 +320,19 @@
           recvoffset = reduce.recvoffset;
           reuse += reduce.count;
         }
+        else if(options.streaming) {
+          // INTRA-NODE PARTIAL SUM IN PLACE, THE RING ADDS TO IT AS IT LANDS
+          reducelist_intra.push_back(REDUCE<T>(reduce.sendbuf, reduce.sendoffset, reduce.recvbuf, reduce.recvoffset, reduce.count, sendids_intra, reduce.recvid));
+          Ranks sendids_ring(sendid, sendid + 1);
+          reduce_stream(sendbuf, sendoffset, sendids_ring, reduce.recvid, true, reduce.recvbuf + reduce.recvoffset, reduce.recvbuf + reduce.recvoffset, reduce.count, coll_stream, options);
+          continue;
+        }
 	else {
           T *recvbuf_intra;
           if(myid == reduce.recvid) {
-	    CommBench::allocate(recvbuf, reduce.count);
-            buffsize += reduce.count;
+	    allocate_buffer(recvbuf, reduce.count);
             recvoffset = 0;
-            CommBench::allocate(recvbuf_intra, reduce.count);
-            buffsize += reduce.count;
+            allocate_buffer(recvbuf_intra, reduce.count);
           }
           reducelist_intra.push_back(REDUCE<T>(reduce.sendbuf, reduce.sendoffset, recvbuf_intra, 0, reduce.count, sendids_intra, reduce.recvid));
           std::vector<T*> inputbuf = {recvbuf, recvbuf_intra};
@@ -312,30 +344,198 @@
         coll_temp->add(sendbuf, sendoffset, recvbuf, recvoffset, reduce.count, sendid, reduce.recvid);
       }
       else
-        reducelist_intra.push_back(REDUCE<T>(reduce.sendbuf, reduce.sendoffset, reduce.recvbuf, reduce.recvoffset, reduce.count, reduce.sendids, reduce.recvid));
+        reducelist_intra.push_back(std::move(reduce));
     }
     /*if(printid == printid) {
       printf("intra reductions: %ld extra reductions: %ld\n\n", reducelist_intra.size(), reducelist_extra.size());
     }*/
 
     if(reducelist_extra.size())
-      reduce_ring(numlevel, groupsize, lib, reducelist_extra, reducelist_intra, coll_list);
+      reduce_ring(numlevel, groupsize, lib, reducelist_extra, reducelist_intra, coll_list, options);
     else {
       // COMPLETE RING WITH INTRA-NODE TREE REDUCTION
       std::vector<int> groupsize_temp(groupsize, groupsize + numlevel);
       groupsize_temp[0] = numproc;
-      std::vector<T*> recvbuff; // for memory recycling
-      reduce_tree(numlevel, groupsize_temp.data(), lib, reducelist_intra, numlevel - 1, coll_list, recvbuff, 0);
+      std::vector<std::pair<T*, size_t>> recvbuff; // for memory recycling
+      reduce_tree(numlevel, groupsize_temp.data(), lib, std::move(reducelist_intra), numlevel - 1, coll_list, recvbuff, 0, options);
+    }
+
+    for(auto &coll : coll_stream)
+      if(coll->numcomm_all + coll->numcompute_all)
+        coll_list.push_back(coll);
+      else
+        delete coll;
+  }
+
+  // CANONICAL (REPRODUCIBLE) REDUCTION: PAIRWISE SUMMATION OVER THE SORTED SENDERS
+  // In each round, the partial sums at positions 2k and 2k + 1 are added (in this order) by the owner of the first one,
+  // the last round is computed by the receiver. The order of additions depends only on the senders, not on the hierarchy,
+  // striping, ring or pipeline; the hierarchy selects the library (and level) of each transfer only.
+  // Received inputs and partial sums are recycled as in reduce_tree: a buffer read in a round is reused from the next round.
+  template <typename T>
+  void reduce_canonical(int numlevel, int groupsize[], CommBench::library lib[], std::vector<REDUCE<T>> &reducelist, std::list<Coll<T>*> &coll_list, bool local) {
+
+    struct PARTIAL {
+      int proc;
+      T *buf;
+      size_t offset;
+      size_t capacity; // of a recycled buffer of this process (0: user buffer)
+    };
+    auto levelof = [&] (int sendid, int recvid) {
+      int level = 0;
+      for(int l = 1; l < numlevel; l++)
+        if(sendid / groupsize[l] == recvid / groupsize[l])
+          level = l;
+      return level;
+    };
+
+    // BUFFERS OF THIS PROCESS: FREE, AND READ IN THIS ROUND (FREE FROM THE NEXT)
+    std::vector<std::pair<T*, size_t>> recvbuf_ptr;
+    std::vector<std::pair<T*, size_t>> recvbuf_read;
+    auto acquire = [&] (size_t count) {
+      for(auto it = recvbuf_ptr.begin(); it != recvbuf_ptr.end(); it++)
+        if(it->second >= count) {
+          std::pair<T*, size_t> buffer = *it;
+          recvbuf_ptr.erase(it);
+          recycle += count; // recycle memory
+          return buffer;
+        }
+      T *recvbuf;
+      allocate_buffer(recvbuf, count);
+      return std::make_pair(recvbuf, count);
+    };
+
+    std::vector<std::vector<PARTIAL>> partial(reducelist.size());
+    std::vector<bool> done(reducelist.size(), false);
+    for(int i = 0; i < reducelist.size(); i++) {
+      std::vector<int> sendids = reducelist[i].sendids.list();
+      std::sort(sendids.begin(), sendids.end());
+      for(auto &sendid : sendids)
+        partial[i].push_back({sendid, reducelist[i].sendbuf, reducelist[i].sendoffset, 0});
+    }
+
+    while(true) {
+      bool finished = true;
+      for(int i = 0; i < reducelist.size(); i++)
+        if(!done[i])
+          finished = false;
+      if(finished)
+        break;
+      // ONE COLL PER LEVEL OF THE ROUND, COMPUTATIONS FOLLOW THE LAST ONE
+      std::vector<Coll<T>*> coll_level(numlevel);
+      // NOT MARKED AS REDUCTION: QUANTIZATION WOULD MAKE THE RESULT DEPEND ON THE LEVELS
+      for(int level = 0; level < numlevel; level++)
+        coll_level[level] = new Coll<T>(lib[level], level, local);
+      std::vector<std::vector<T*>> inputbuf_round;
+      std::vector<T*> outputbuf_round;
+      std::vector<size_t> count_round;
+      std::vector<int> compid_round;
+      for(int i = 0; i < reducelist.size(); i++) {
+        REDUCE<T> &reduce = reducelist[i];
+        if(done[i])
+          continue;
+        std::vector<PARTIAL> partial_new;
+        if(partial[i].size() == 1) {
+          // SINGLE SENDER: COPY INTO THE RECEIVE BUFFER
+          PARTIAL &p = partial[i][0];
+          coll_level[levelof(p.proc, reduce.recvid)]->add(p.buf, p.offset, reduce.recvbuf, reduce.recvoffset, reduce.count, p.proc, reduce.recvid);
+          if(p.capacity)
+            recvbuf_read.push_back(std::make_pair(p.buf, p.capacity));
+          partial_new.push_back({reduce.recvid, reduce.recvbuf, reduce.recvoffset, 0});
+          done[i] = true;
+        }
+        else {
+          bool last = (partial[i].size() == 2);
+          done[i] = last;
+          for(int k = 0; k + 1 < partial[i].size(); k += 2) {
+            int compid = (last ? reduce.recvid : partial[i][k].proc);
+            std::vector<T*> inputbuf;
+            for(int j = k; j < k + 2; j++) {
+              PARTIAL &p = partial[i][j];
+              if(p.capacity)
+                recvbuf_read.push_back(std::make_pair(p.buf, p.capacity));
+              if(p.proc == compid)
+                inputbuf.push_back(p.buf + p.offset);
+              else {
+                T *recvbuf;
+                if(myid == compid) {
+                  std::pair<T*, size_t> buffer = acquire(reduce.count);
+                  recvbuf = buffer.first;
+                  recvbuf_read.push_back(buffer);
+                }
+                coll_level[levelof(p.proc, compid)]->add(p.buf, p.offset, recvbuf, 0, reduce.count, p.proc, compid);
+                inputbuf.push_back(recvbuf);
+              }
+            }
+            T *outputbuf = reduce.recvbuf;
+            size_t outputoffset = reduce.recvoffset;
+            size_t capacity = 0;
+            if(!last) {
+              if(myid == compid) {
+                std::pair<T*, size_t> buffer = acquire(reduce.count);
+                outputbuf = buffer.first;
+                capacity = buffer.second;
+              }
+              outputoffset = 0;
+            }
+            inputbuf_round.push_back(inputbuf);
+            outputbuf_round.push_back(outputbuf + outputoffset);
+            count_round.push_back(reduce.count);
+            compid_round.push_back(compid);
+            partial_new.push_back({compid, outputbuf, outputoffset, capacity});
+          }
+          if(partial[i].size() % 2)
+            partial_new.push_back(partial[i].back());
+        }
+        partial[i] = partial_new;
+      }
+      int last = -1;
+      for(int level = 0; level < numlevel; level++)
+        if(coll_level[level]->numcomm_all)
+          last = level;
+      if(last == -1)
+        last = numlevel - 1;
+      for(int comp = 0; comp < compid_round.size(); comp++)
+        coll_level[last]->add(inputbuf_round[comp], outputbuf_round[comp], count_round[comp], compid_round[comp]);
+      for(int level = 0; level < numlevel; level++)
+        if(coll_level[level]->numcomm_all + coll_level[level]->numcompute_all)
+          coll_list.push_back(coll_level[level]);
+        else
+          delete coll_level[level];
+      recvbuf_ptr.insert(recvbuf_ptr.end(), recvbuf_read.begin(), recvbuf_read.end());
+      recvbuf_read.clear();
     }
+  }
 
-    if(coll_temp->numcomm + coll_temp->numcompute)
-      coll_list.push_back(coll_temp);
-    else
-      delete coll_temp;
+  // SPLIT count OVER THE numstripe PROCESSES OF A NODE, EQUALLY OR IN PROPORTION TO THEIR stripe_weight
+  // (THE SAME ON ALL PROCESSES, STRIPES OF ZERO WEIGHT GET NOTHING)
+  inline void stripe_split(size_t count, int numstripe, int node, std::vector<size_t> &splitcount, const std::vector<double> &stripe_weight) {
+    splitcount.resize(numstripe);
+    double total = 0;
+    if(stripe_weight.size())
+      for(int stripe = 0; stripe < numstripe; stripe++)
+        total += stripe_weight[node * numstripe + stripe];
+    if(total <= 0) {
+      for(int stripe = 0; stripe < numstripe; stripe++)
+        splitcount[stripe] = count / numstripe + (stripe < count % numstripe ? 1 : 0);
+      return;
+    }
+    double prefix = 0;
+    size_t offset = 0;
+    for(int stripe = 0; stripe < numstripe; stripe++) {
+      prefix += stripe_weight[node * numstripe + stripe];
+      size_t end = (stripe == numstripe - 1 ? count : std::min(count, (size_t)(count * (prefix / total))));
+      end = std::max(end, offset);
+      splitcount[stripe] = end - offset;
+      offset = end;
+    }
   }
 
+  // STRIPE THE PRIMITIVES THAT STAY WITHIN A GROUP OF groupsize PROCESSES (numproc AT LEVEL 0) BUT LEAVE THE GROUP OF nextsize PROCESSES OF THE RECEIVER
+  // (THE GROUP OF THE NEXT LEVEL, OR THE NODE OF numstripe PROCESSES AT LEVEL 0) OVER THE numstripe PROCESSES OF THE RECEIVER
+  // THE PIECES GO TO stripe_list (SO THAT A LOWER LEVEL DOES NOT STRIPE THEM AGAIN), THE REST (AND ALL FOR A SINGLE STRIPE) STAYS IN reducelist
   template <typename T, typename P>
-  void stripe(int numstripe, std::vector<REDUCE<T>> &reducelist, std::vector<P> &merge_list) {
+  void stripe(int numstripe, int groupsize, int nextsize, std::vector<REDUCE<T>> &reducelist, std::vector<REDUCE<T>> &stripe_list, std::vector<P> &merge_list, const Options &options) {
 
     int nodesize = numstripe;
 
@@ -343,42 +543,36 @@
     std::vector<REDUCE<T>> reducelist_intra;
     std::vector<REDUCE<T>> reducelist_inter;
     for(auto &reduce : reducelist) {
-      int recvid = reduce.recvid;
-      std::vector<int> sendid_intra;
-      std::vector<int> sendid_inter;
-      for(auto &sendid : reduce.sendids)
-        if(sendid / nodesize == recvid / nodesize)
-          sendid_intra.push_back(sendid);
-        else
-          sendid_inter.push_back(sendid);
-      if(sendid_inter.size())
-        reducelist_inter.push_back(REDUCE<T>(reduce.sendbuf, reduce.sendoffset, reduce.recvbuf, reduce.recvoffset, reduce.count, reduce.sendids, reduce.recvid));
+      int recvnext = reduce.recvid / nextsize;
+      int recvgroup = reduce.recvid / groupsize;
+      bool inter = reduce.sendids.count(recvnext * nextsize, (recvnext + 1) * nextsize) < reduce.sendids.size();
+      bool inside = reduce.sendids.count(recvgroup * groupsize, (recvgroup + 1) * groupsize) == reduce.sendids.size();
+      if(inter && inside)
+        reducelist_inter.push_back(std::move(reduce));
       else
-        reducelist_intra.push_back(REDUCE<T>(reduce.sendbuf, reduce.sendoffset, reduce.recvbuf, reduce.recvoffset, reduce.count, reduce.sendids, reduce.recvid));
+        reducelist_intra.push_back(std::move(reduce));
     }
-    // CLEAR REDUCELIST
-    reducelist.clear();
     // ADD INTRA-NODE REDUCTION DIRECTLY (IF ANY)
-    for(auto &reduce : reducelist_intra)
-      reducelist.push_back(REDUCE<T>(reduce.sendbuf, reduce.sendoffset, reduce.recvbuf, reduce.recvoffset, reduce.count, reduce.sendids, reduce.recvid));
+    reducelist = std::move(reducelist_intra);
 
     // ADD INTER-NODE REDUCTIONS BY STRIPING
     if(reducelist_inter.size())
     {
       for(auto &reduce : reducelist_inter) {
         int recvnode = reduce.recvid / nodesize;
+        std::vector<size_t> split;
+        stripe_split(reduce.count, numstripe, recvnode, split, options.stripe_weight);
         size_t splitoffset = 0;
         for(int stripe = 0; stripe < numstripe; stripe++) {
           int recver = recvnode * nodesize + stripe;
-          size_t splitcount = reduce.count / numstripe + (stripe < reduce.count % numstripe ? 1 : 0);
-          if(splitcount) {
+          size_t splitcount = split[stripe];
+          if(splitcount || options.parametric) {
             T *recvbuf;
             size_t recvoffset;
             if(recver != reduce.recvid) {
               if(myid == recver) {
-                CommBench::allocate(recvbuf, splitcount);
+                allocate_buffer(recvbuf, splitcount);
                 recvoffset = 0;
-                buffsize += splitcount;
               }
               merge_list.push_back(P(recvbuf, recvoffset, reduce.recvbuf, reduce.recvoffset + splitoffset, splitcount, recver, reduce.recvid));
             }
@@ -388,23 +582,24 @@
                 recvoffset = reduce.recvoffset + splitoffset;
                 reuse += splitcount;
               }
-            reducelist.push_back(REDUCE<T>(reduce.sendbuf, reduce.sendoffset + splitoffset, recvbuf, recvoffset, splitcount, reduce.sendids, recver));
+            (numstripe > 1 ? stripe_list : reducelist).push_back(REDUCE<T>(reduce.sendbuf, reduce.sendoffset + splitoffset, recvbuf, recvoffset, splitcount, reduce.sendids, recver));
             splitoffset += splitcount;
           }
-          else
-            break;
         }
       }
     }
   }
 
+  // SPLIT EACH PRIMITIVE INTO numbatch EQUAL PIECES, OR INTO PIECES OF chunk ELEMENTS IF GIVEN (TRAILING BATCHES MAY BE EMPTY)
   template <typename T>
-  void partition(std::vector<REDUCE<T>> &reducelist, int numbatch, std::vector<std::vector<REDUCE<T>>> &reduce_batch) {
+  void partition(std::vector<REDUCE<T>> &reducelist, int numbatch, std::vector<std::vector<REDUCE<T>>> &reduce_batch, size_t chunk = 0, bool parametric = false) {
     for(auto &reduce : reducelist) {
       size_t batchoffset = 0;
       for(int batch = 0; batch < numbatch; batch++) {
         size_t batchsize = reduce.count / numbatch + (batch < reduce.count % numbatch ? 1 : 0);
-        if(batchsize) {
+        if(chunk)
+          batchsize = std::min(chunk, reduce.count - batchoffset);
+        if(batchsize || parametric) {
           reduce_batch[batch].push_back(REDUCE<T>(reduce.sendbuf, reduce.sendoffset + batchoffset, reduce.recvbuf, reduce.recvoffset + batchoffset, batchsize, reduce.sendids, reduce.recvid));
           batchoffset += batchsize;
         }
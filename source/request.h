@@ -0,0 +1,221 @@
+  // IN-FLIGHT COLLECTIVES
+  // Each start() issues a request with a ticket. Every plan has its own communicator, so its compressed messages and its
+  // collectives (rebinding, tickets) never match those of other plans. Raw transfers go through CommBench, whose lanes post
+  // on the communicator of CommBench: a request runs in its own thread as soon as no request before it that is still in
+  // flight conflicts with it: the same plan, or a plan with a common pair of processes in raw transfers, whose messages
+  // could otherwise match each other. Plans on disjoint pairs or with compressed transfers only progress concurrently.
+  // Requests are ordered by (ticket, plan): when a plan may conflict with others, its ticket is agreed over the processes of
+  // the plan (maximum of their counters), so that all processes order conflicting requests the same way. The order does not
+  // depend on the requests a process happens to have in flight: a ticket is reserved (at the local counter) before it is agreed,
+  // and a request does not run while a conflicting reservation at or below its ticket is being agreed, since that one may sort
+  // before it. A request agreed later on a process sorts after all requests issued there before (the counter has passed them).
+  // Start the collectives of each plan in the same order on every process (as for nonblocking MPI collectives), and do not make
+  // the start() of a plan wait for a request of a conflicting plan started after it on another thread. The blocking run() is not
+  // ordered: threads that run conflicting plans at the same time use start() and wait() (collectives/threads.cpp).
+  // Concurrent requests call MPI from several threads: without MPI_THREAD_MULTIPLE, all requests are serialized.
+
+  class Request {
+
+    public:
+
+    unsigned long ticket;
+    unsigned long order; // of the plan (in the order of initialization), breaks the ties of tickets
+    const void *plan;
+    const std::vector<std::pair<int, int>> *pairs; // sorted pairs of processes (smaller id first)
+    void (*body)(Request*);
+    void *pipeline;
+    bool done = false;
+    pthread_t thread;
+  };
+
+  // TICKET RESERVED AT THE LOCAL COUNTER WHILE IT IS AGREED
+  struct Pending {
+    unsigned long ticket;
+    const void *plan;
+    const std::vector<std::pair<int, int>> *pairs;
+  };
+
+  static pthread_mutex_t request_mutex = PTHREAD_MUTEX_INITIALIZER;
+  static pthread_cond_t request_cond = PTHREAD_COND_INITIALIZER;
+  static unsigned long request_ticket = 0;
+  static std::list<Request*> request_inflight;
+  static std::list<Pending*> request_pending;
+  static int request_thread_level = -1;
+  static unsigned long request_order = 0; // plans initialized so far
+
+  inline int thread_level() {
+    if(request_thread_level == -1) {
+      MPI_Query_thread(&request_thread_level);
+      if(request_thread_level < MPI_THREAD_MULTIPLE && myid == printid)
+        printf("HiCCL: MPI is not initialized with MPI_THREAD_MULTIPLE, requests are serialized\n");
+    }
+    return request_thread_level;
+  }
+
+  // RESERVE THE NEXT LOCAL TICKET OF A PLAN, TO BE AGREED AND PASSED TO issue()
+  inline Pending* reserve(const void *plan, const std::vector<std::pair<int, int>> *pairs) {
+    thread_level();
+    pthread_mutex_lock(&request_mutex);
+    Pending *pending = new Pending{request_ticket, plan, pairs};
+    request_pending.push_back(pending);
+    pthread_mutex_unlock(&request_mutex);
+    return pending;
+  }
+
+  // TICKET AGREED OVER THE PROCESSES OF THE PLAN (COLLECTIVE ON ITS COMMUNICATOR)
+  inline unsigned long agree(MPI_Comm comm, const Pending *pending) {
+    unsigned long ticket = pending->ticket;
+    MPI_Allreduce(MPI_IN_PLACE, &ticket, 1, MPI_UNSIGNED_LONG, MPI_MAX, comm);
+    return ticket;
+  }
+
+  inline bool before(const Request *a, const Request *b) {
+    return a->ticket < b->ticket || (a->ticket == b->ticket && a->order < b->order);
+  }
+
+  inline bool overlap(const std::vector<std::pair<int, int>> &a, const std::vector<std::pair<int, int>> &b) {
+    auto i = a.begin();
+    auto j = b.begin();
+    while(i != a.end() && j != b.end()) {
+      if(*i < *j)
+        i++;
+      else if(*j < *i)
+        j++;
+      else
+        return true;
+    }
+    return false;
+  }
+
+  // CALLED WITH request_mutex LOCKED
+  inline bool conflict(Request *request) {
+    for(auto &other : request_inflight) {
+      if(!before(other, request) || other->done)
+        continue;
+      if(other->plan == request->plan || request_thread_level < MPI_THREAD_MULTIPLE || overlap(*other->pairs, *request->pairs))
+        return true;
+    }
+    for(auto &other : request_pending) {
+      if(other->ticket > request->ticket)
+        continue;
+      if(other->plan == request->plan || request_thread_level < MPI_THREAD_MULTIPLE || overlap(*other->pairs, *request->pairs))
+        return true;
+    }
+    return false;
+  }
+
+  inline void* request_thread(void *arg) {
+    Request *request = (Request*) arg;
+    CommBench::setup_gpu();
+    pthread_mutex_lock(&request_mutex);
+    while(conflict(request))
+      pthread_cond_wait(&request_cond, &request_mutex);
+    pthread_mutex_unlock(&request_mutex);
+    request->body(request);
+    pthread_mutex_lock(&request_mutex);
+    request->done = true;
+    pthread_cond_broadcast(&request_cond);
+    pthread_mutex_unlock(&request_mutex);
+    return NULL;
+  }
+
+  // ISSUE WITH THE TICKET AGREED FOR A RESERVATION (RELEASED HERE), OR WITH THE NEXT LOCAL TICKET WITHOUT ONE
+  inline Request* issue(const void *plan, unsigned long order, const std::vector<std::pair<int, int>> *pairs, void (*body)(Request*), void *pipeline, unsigned long ticket = 0, Pending *pending = nullptr) {
+    thread_level();
+    Request *request = new Request();
+    request->order = order;
+    request->plan = plan;
+    request->pairs = pairs;
+    request->body = body;
+    request->pipeline = pipeline;
+    pthread_mutex_lock(&request_mutex);
+    request->ticket = (pending ? ticket : request_ticket);
+    request_ticket = std::max(request_ticket, request->ticket + 1);
+    request_inflight.push_back(request);
+    if(pending) {
+      request_pending.remove(pending);
+      delete pending;
+      pthread_cond_broadcast(&request_cond);
+    }
+    pthread_mutex_unlock(&request_mutex);
+    pthread_create(&request->thread, NULL, request_thread, request);
+    return request;
+  }
+
+  // NONBLOCKING COMPLETION CHECK
+  inline bool test(Request *request) {
+    pthread_mutex_lock(&request_mutex);
+    bool done = request->done;
+    pthread_mutex_unlock(&request_mutex);
+    return done;
+  }
+
+  // COMPLETE AND RELEASE THE REQUEST
+  inline void wait(Request *request) {
+    pthread_join(request->thread, NULL);
+    pthread_mutex_lock(&request_mutex);
+    request_inflight.remove(request);
+    pthread_mutex_unlock(&request_mutex);
+    delete request;
+  }
+
+  inline void wait_all(std::vector<Request*> &requests) {
+    for(auto &request : requests)
+      if(request) {
+        wait(request);
+        request = nullptr;
+      }
+  }
+
+  // COMPLETE ONE OF THE REQUESTS, RETURNS ITS INDEX (-1 IF NONE IS LEFT) AND SETS IT TO nullptr
+  inline int wait_any(std::vector<Request*> &requests) {
+    int index = -1;
+    pthread_mutex_lock(&request_mutex);
+    while(true) {
+      bool left = false;
+      for(int i = 0; i < requests.size(); i++)
+        if(requests[i]) {
+          left = true;
+          if(requests[i]->done) {
+            index = i;
+            break;
+          }
+        }
+      if(index > -1 || !left)
+        break;
+      pthread_cond_wait(&request_cond, &request_mutex);
+    }
+    pthread_mutex_unlock(&request_mutex);
+    if(index > -1) {
+      wait(requests[index]);
+      requests[index] = nullptr;
+    }
+    return index;
+  }
+
+  // WAIT UNTIL NO REQUEST OF THE PLAN IS IN FLIGHT (WITHOUT RELEASING THEM)
+  inline void drain(const void *plan) {
+    pthread_mutex_lock(&request_mutex);
+    while(true) {
+      bool busy = false;
+      for(auto &request : request_inflight)
+        if(request->plan == plan && !request->done)
+          busy = true;
+      if(!busy)
+        break;
+      pthread_cond_wait(&request_cond, &request_mutex);
+    }
+    pthread_mutex_unlock(&request_mutex);
+  }
+
+  // COMPLETE AND RELEASE ALL REQUESTS OF THE PLAN
+  inline void wait_plan(const void *plan) {
+    std::vector<Request*> requests;
+    pthread_mutex_lock(&request_mutex);
+    for(auto &request : request_inflight)
+      if(request->plan == plan)
+        requests.push_back(request);
+    pthread_mutex_unlock(&request_mutex);
+    for(auto &request : requests)
+      wait(request);
+  }
@@ -0,0 +1,524 @@
+
+  // SCHEDULE (INTERMEDIATE REPRESENTATION OF A PLAN)
+  // Batches of steps (before staggering), each step with transfers followed by reductions. Buffers are symbolic: sK is
+  // the scratch buffer K of a process (in order of allocation by the planner) and uK is the user buffer K of a process (in
+  // order of first appearance in the primitives, or as given to load). A reference is a buffer of the process that sends,
+  // receives or computes, plus an offset in elements. The schedule is identical on all processes: lower() resolves the
+  // references of each process and combines them, raise() binds them to the local pointers again.
+  enum pass {self_copy, redundant_copy, multicast};
+
+  template <typename T>
+  class Schedule {
+
+    public:
+
+    struct Ref {
+      long buffer; // scratch buffer (>= 0) or user buffer -buffer - 1 (< 0)
+      size_t offset;
+    };
+    struct Transfer {
+      int sendid;
+      Ref send;
+      int recvid;
+      Ref recv;
+      size_t count;
+    };
+    struct Reduce {
+      int compid;
+      std::vector<Ref> input;
+      Ref output;
+      size_t count;
+    };
+    struct Step {
+      int lib;
+      int level;
+      bool reduction = false;
+      bool pipelined = false;
+      std::vector<Transfer> transfer;
+      std::vector<Reduce> reduce;
+    };
+
+    std::vector<std::vector<size_t>> scratch; // counts of the scratch buffers of each process
+    std::vector<std::vector<Step>> batch;
+    std::vector<int> batchoffset;
+    // LOCAL BINDING
+    std::vector<T*> scratch_ptr;
+    std::vector<T*> user_ptr;
+
+    // FROM COLLS (buffers: SCRATCH BUFFERS OF THIS PROCESS WITH THEIR SIZE IN BYTES)
+    void lower(std::vector<std::list<Coll<T>*>> &coll_batch, std::vector<int> &batchoffset, std::vector<std::pair<void*, size_t>> &buffers, std::vector<T*> &user) {
+      std::map<T*, long> base;
+      std::vector<size_t> count_local;
+      scratch_ptr.clear();
+      for(auto &buffer : buffers)
+        if(base.find((T*) buffer.first) == base.end()) {
+          base[(T*) buffer.first] = scratch_ptr.size();
+          scratch_ptr.push_back((T*) buffer.first);
+          count_local.push_back(buffer.second / sizeof(T));
+        }
+      user_ptr = user;
+      auto resolve = [&] (T *ptr) {
+        Ref ref = {LONG_MIN, 0};
+        auto it = base.upper_bound(ptr);
+        if(it != base.begin()) {
+          it--;
+          if(ptr <= it->first + count_local[it->second]) {
+            ref.buffer = it->second;
+            ref.offset = ptr - it->first;
+            return ref;
+          }
+        }
+        int nearest = -1; // user buffer with the nearest base below
+        for(int u = 0; u < user.size(); u++)
+          if(user[u] <= ptr && (nearest == -1 || user[u] > user[nearest]))
+            nearest = u;
+        if(nearest > -1) {
+          ref.buffer = -nearest - 1;
+          ref.offset = ptr - user[nearest];
+        }
+        else
+          printf("ERROR!!! myid %d cannot resolve buffer %p in the schedule\n", myid, ptr);
+        return ref;
+      };
+      // RESOLVE OWN REFERENCES, COMBINE ACROSS PROCESSES
+      std::vector<long> id;
+      std::vector<unsigned long> offset;
+      auto visit = [&] (T *ptr, size_t off, int owner) {
+        Ref ref = {LONG_MIN, 0};
+        if(myid == owner)
+          ref = resolve(ptr + off);
+        id.push_back(ref.buffer);
+        offset.push_back(ref.offset);
+      };
+      for(auto &list : coll_batch)
+        for(auto &coll : list) {
+          for(int i = 0; i < coll->numcomm; i++) {
+            visit(coll->sendbuf[i], coll->sendoffset[i], coll->sendid[i]);
+            visit(coll->recvbuf[i], coll->recvoffset[i], coll->recvid[i]);
+          }
+          for(int i = 0; i < coll->numcompute; i++) {
+            for(auto &input : coll->inputbuf[i])
+              visit(input, 0, coll->compid[i]);
+            visit(coll->outputbuf[i], 0, coll->compid[i]);
+          }
+        }
+      MPI_Allreduce(MPI_IN_PLACE, id.data(), id.size(), MPI_LONG, MPI_MAX, comm_mpi);
+      MPI_Allreduce(MPI_IN_PLACE, offset.data(), offset.size(), MPI_UNSIGNED_LONG, MPI_MAX, comm_mpi);
+      for(auto &buffer : id)
+        if(buffer == LONG_MIN) {
+          if(myid == printid)
+            printf("ERROR!!! schedule has unresolved buffers\n");
+          break;
+        }
+      // SCRATCH BUFFERS OF ALL PROCESSES
+      {
+        int numbuffer = count_local.size();
+        std::vector<int> numbuffer_all(numproc);
+        MPI_Allgather(&numbuffer, 1, MPI_INT, numbuffer_all.data(), 1, MPI_INT, comm_mpi);
+        std::vector<int> displ(numproc + 1, 0);
+        for(int p = 0; p < numproc; p++)
+          displ[p + 1] = displ[p] + numbuffer_all[p];
+        std::vector<unsigned long> count_all(displ[numproc]);
+        std::vector<unsigned long> count_send(count_local.begin(), count_local.end());
+        MPI_Allgatherv(count_send.data(), numbuffer, MPI_UNSIGNED_LONG, count_all.data(), numbuffer_all.data(), displ.data(), MPI_UNSIGNED_LONG, comm_mpi);
+        scratch.assign(numproc, std::vector<size_t>());
+        for(int p = 0; p < numproc; p++)
+          scratch[p].assign(count_all.begin() + displ[p], count_all.begin() + displ[p + 1]);
+      }
+      // STEPS
+      batch.assign(coll_batch.size(), std::vector<Step>());
+      this->batchoffset = batchoffset;
+      size_t next = 0;
+      auto take = [&] () {
+        Ref ref = {id[next], offset[next]};
+        next++;
+        return ref;
+      };
+      for(int b = 0; b < coll_batch.size(); b++)
+        for(auto &coll : coll_batch[b]) {
+          Step step;
+          step.lib = coll->lib;
+          step.level = coll->level;
+          step.reduction = coll->reduction;
+          step.pipelined = coll->pipelined;
+          for(int i = 0; i < coll->numcomm; i++) {
+            Transfer transfer;
+            transfer.sendid = coll->sendid[i];
+            transfer.send = take();
+            transfer.recvid = coll->recvid[i];
+            transfer.recv = take();
+            transfer.count = coll->count[i];
+            step.transfer.push_back(transfer);
+          }
+          for(int i = 0; i < coll->numcompute; i++) {
+            Reduce reduce;
+            reduce.compid = coll->compid[i];
+            for(int in = 0; in < coll->inputbuf[i].size(); in++)
+              reduce.input.push_back(take());
+            reduce.output = take();
+            reduce.count = coll->numreduce[i];
+            step.reduce.push_back(reduce);
+          }
+          batch[b].push_back(step);
+        }
+    }
+
+    // TO COLLS (REPLACES coll_batch), ALLOCATES THE SCRATCH BUFFERS OF A LOADED SCHEDULE (local: KEEP THE TRANSFERS OF myid ONLY)
+    void raise(std::vector<std::list<Coll<T>*>> &coll_batch, std::vector<int> &batchoffset, bool local = false) {
+      for(int k = scratch_ptr.size(); k < scratch[myid].size(); k++) {
+        T *buffer;
+        allocate_buffer(buffer, scratch[myid][k]);
+        scratch_ptr.push_back(buffer);
+      }
+      auto bind = [&] (const Ref &ref) {
+        if(ref.buffer >= 0)
+          return scratch_ptr[ref.buffer];
+        if(-ref.buffer - 1 < user_ptr.size())
+          return user_ptr[-ref.buffer - 1];
+        printf("ERROR!!! myid %d user buffer u%ld is not given\n", myid, -ref.buffer - 1);
+        return (T*) nullptr;
+      };
+      for(auto &list : coll_batch)
+        for(auto &coll : list)
+          delete coll;
+      coll_batch.assign(batch.size(), std::list<Coll<T>*>());
+      batchoffset = this->batchoffset;
+      for(int b = 0; b < batch.size(); b++)
+        for(auto &step : batch[b]) {
+          if(step.transfer.size() + step.reduce.size() == 0)
+            continue;
+          Coll<T> *coll = new Coll<T>((CommBench::library) step.lib, step.level, local);
+          coll->reduction = step.reduction;
+          coll->pipelined = step.pipelined;
+          for(auto &t : step.transfer)
+            coll->add(myid == t.sendid ? bind(t.send) : nullptr, t.send.offset, myid == t.recvid ? bind(t.recv) : nullptr, t.recv.offset, t.count, t.sendid, t.recvid);
+          for(auto &r : step.reduce) {
+            std::vector<T*> inputbuf(r.input.size(), nullptr);
+            T *outputbuf = nullptr;
+            if(myid == r.compid) {
+              for(int in = 0; in < r.input.size(); in++)
+                inputbuf[in] = bind(r.input[in]) + r.input[in].offset;
+              outputbuf = bind(r.output) + r.output.offset;
+            }
+            coll->add(inputbuf, outputbuf, r.count, r.compid);
+          }
+          coll_batch[b].push_back(coll);
+        }
+    }
+
+    // TEXT FORMAT (WRITTEN BY PROCESS 0)
+    static std::string print(const Ref &ref) {
+      return (ref.buffer < 0 ? "u" + std::to_string(-ref.buffer - 1) : "s" + std::to_string(ref.buffer)) + "+" + std::to_string(ref.offset);
+    }
+    void dump(std::string filename) {
+      if(myid != 0)
+        return;
+      std::ofstream file(filename);
+      if(!file) {
+        printf("ERROR!!! cannot write schedule %s\n", filename.c_str());
+        return;
+      }
+      file << "# HiCCL schedule: sK / uK is scratch / user buffer K of the process, + offset in elements\n";
+      file << "processes " << numproc << "\n";
+      for(int p = 0; p < numproc; p++) {
+        file << "scratch " << p;
+        for(auto &count : scratch[p])
+          file << " " << count;
+        file << "\n";
+      }
+      for(int b = 0; b < batch.size(); b++) {
+        file << "batch " << b << " offset " << batchoffset[b] << "\n";
+        for(auto &step : batch[b]) {
+          file << "step lib " << step.lib << " level " << step.level << " reduction " << step.reduction << " pipelined " << step.pipelined << "\n";
+          for(auto &t : step.transfer)
+            file << "  transfer " << t.sendid << " " << print(t.send) << " -> " << t.recvid << " " << print(t.recv) << " count " << t.count << "\n";
+          for(auto &r : step.reduce) {
+            file << "  reduce " << r.compid;
+            for(auto &input : r.input)
+              file << " " << print(input);
+            file << " -> " << print(r.output) << " count " << r.count << "\n";
+          }
+        }
+      }
+      file << "end\n";
+      printf("schedule written to %s\n", filename.c_str());
+    }
+
+    // READ BY PROCESS 0 AND BROADCAST, RETURNS false ON ERROR
+    bool load(std::string filename) {
+      std::string text;
+      {
+        long size = -1;
+        if(myid == 0) {
+          std::ifstream file(filename);
+          if(file) {
+            std::stringstream buffer;
+            buffer << file.rdbuf();
+            text = buffer.str();
+            size = text.size();
+          }
+        }
+        MPI_Bcast(&size, 1, MPI_LONG, 0, comm_mpi);
+        if(size < 0) {
+          if(myid == printid)
+            printf("ERROR!!! cannot read schedule %s\n", filename.c_str());
+          return false;
+        }
+        text.resize(size);
+        MPI_Bcast(&text[0], size, MPI_CHAR, 0, comm_mpi);
+      }
+      auto parse = [] (const std::string &token, Ref &ref) {
+        char kind;
+        long buffer;
+        size_t offset;
+        if(sscanf(token.c_str(), "%c%ld+%zu", &kind, &buffer, &offset) != 3 || (kind != 's' && kind != 'u'))
+          return false;
+        ref.buffer = (kind == 's' ? buffer : -buffer - 1);
+        ref.offset = offset;
+        return true;
+      };
+      scratch.assign(numproc, std::vector<size_t>());
+      batch.clear();
+      batchoffset.clear();
+      std::istringstream input(text);
+      std::string line;
+      int lineno = 0;
+      bool end = false;
+      while(std::getline(input, line)) {
+        lineno++;
+        std::istringstream tokens(line);
+        std::string key;
+        if(!(tokens >> key) || key[0] == '#')
+          continue;
+        bool valid = true;
+        if(key == "processes") {
+          int numproc_file = 0;
+          tokens >> numproc_file;
+          valid = (numproc_file == numproc);
+        }
+        else if(key == "scratch") {
+          int p = -1;
+          size_t count;
+          tokens >> p;
+          valid = (p > -1 && p < numproc);
+          while(valid && tokens >> count)
+            scratch[p].push_back(count);
+        }
+        else if(key == "batch") {
+          int b;
+          std::string word;
+          int offset = 0;
+          valid = (tokens >> b >> word >> offset) && word == "offset";
+          batch.push_back(std::vector<Step>());
+          batchoffset.push_back(offset);
+        }
+        else if(key == "step") {
+          Step step;
+          std::string word[4];
+          int reduction, pipelined;
+          valid = batch.size() && (tokens >> word[0] >> step.lib >> word[1] >> step.level >> word[2] >> reduction >> word[3] >> pipelined);
+          step.reduction = reduction;
+          step.pipelined = pipelined;
+          if(valid)
+            batch.back().push_back(step);
+        }
+        else if(key == "transfer") {
+          Transfer t;
+          std::string send, arrow, recv, word;
+          valid = batch.size() && batch.back().size() && (tokens >> t.sendid >> send >> arrow >> t.recvid >> recv >> word >> t.count) && arrow == "->" && word == "count";
+          valid = valid && parse(send, t.send) && parse(recv, t.recv) && (t.sendid > -1) && (t.sendid < numproc) && (t.recvid > -1) && (t.recvid < numproc);
+          if(valid)
+            batch.back().back().transfer.push_back(t);
+        }
+        else if(key == "reduce") {
+          Reduce r;
+          std::string token;
+          valid = batch.size() && batch.back().size() && (tokens >> r.compid) && (r.compid > -1) && (r.compid < numproc);
+          while(valid && tokens >> token && token != "->") {
+            Ref ref;
+            valid = parse(token, ref);
+            r.input.push_back(ref);
+          }
+          std::string output, word;
+          valid = valid && token == "->" && (tokens >> output >> word >> r.count) && word == "count" && parse(output, r.output);
+          if(valid)
+            batch.back().back().reduce.push_back(r);
+        }
+        else if(key == "end")
+          end = true;
+        else
+          valid = false;
+        if(!valid) {
+          if(myid == printid)
+            printf("ERROR!!! schedule %s line %d: %s\n", filename.c_str(), lineno, line.c_str());
+          return false;
+        }
+      }
+      if(!end && myid == printid)
+        printf("WARNING: schedule %s has no end\n", filename.c_str());
+      scratch_ptr.clear();
+      return true;
+    }
+
+    // PASSES
+    static bool overlap(int p, const Ref &a, size_t m, int q, const Ref &b, size_t n) {
+      return p == q && a.buffer == b.buffer && a.offset < b.offset + n && b.offset < a.offset + m;
+    }
+    void prune() {
+      for(auto &steps : batch) {
+        std::vector<Step> steps_new;
+        for(auto &step : steps)
+          if(step.transfer.size() + step.reduce.size())
+            steps_new.push_back(step);
+        steps = steps_new;
+      }
+    }
+    // TRUE IF A TRANSFER OR A REDUCTION OF THE STEP (EXCEPT transfer skip) WRITES THE REGION
+    bool writes(Step &step, int p, const Ref &ref, size_t count, bool reduce, const Transfer *skip = nullptr) {
+      for(auto &t : step.transfer)
+        if(&t != skip && overlap(t.recvid, t.recv, t.count, p, ref, count))
+          return true;
+      if(reduce)
+        for(auto &r : step.reduce)
+          if(overlap(r.compid, r.output, r.count, p, ref, count))
+            return true;
+      return false;
+    }
+
+    // COPIES OF A REGION ONTO ITSELF (e.g., bcast_tree LEAVES WHEN sendbuf AND recvbuf ALIAS)
+    int elide_self_copy() {
+      int numelide = 0;
+      for(auto &steps : batch)
+        for(auto &step : steps) {
+          std::vector<Transfer> transfer;
+          for(auto &t : step.transfer)
+            if(t.sendid == t.recvid && t.send.buffer == t.recv.buffer && t.send.offset == t.recv.offset)
+              numelide++;
+            else
+              transfer.push_back(t);
+          step.transfer = transfer;
+        }
+      prune();
+      return numelide;
+    }
+
+    static bool same(const Transfer &a, const Transfer &b) {
+      return a.sendid == b.sendid && a.recvid == b.recvid && a.count == b.count && a.send.buffer == b.send.buffer && a.send.offset == b.send.offset && a.recv.buffer == b.recv.buffer && a.recv.offset == b.recv.offset;
+    }
+
+    // REPEATED TRANSFERS (NEITHER END WRITTEN IN BETWEEN) AND TRANSFERS INTO SCRATCH THAT IS NEVER READ
+    int eliminate_redundant_copy() {
+      int numelim = 0;
+      for(auto &steps : batch)
+        for(int s = 0; s < steps.size(); s++) {
+          std::vector<Transfer> transfer;
+          for(int j = 0; j < steps[s].transfer.size(); j++) {
+            Transfer &t = steps[s].transfer[j];
+            bool redundant = false;
+            for(int k = 0; k < j; k++)
+              if(same(steps[s].transfer[k], t))
+                redundant = true;
+            // SEARCH BACK WHILE NO STEP WRITES EITHER END
+            bool clean = !writes(steps[s], t.sendid, t.send, t.count, false, &t) && !writes(steps[s], t.recvid, t.recv, t.count, false, &t);
+            for(int s1 = s - 1; s1 > -1 && clean && !redundant; s1--) {
+              const Transfer *t1 = nullptr;
+              for(auto &transfer : steps[s1].transfer)
+                if(same(transfer, t))
+                  t1 = &transfer;
+              clean = !writes(steps[s1], t.sendid, t.send, t.count, true, t1) && !writes(steps[s1], t.recvid, t.recv, t.count, true, t1);
+              redundant = (t1 && clean);
+            }
+            if(redundant)
+              numelim++;
+            else
+              transfer.push_back(t);
+          }
+          steps[s].transfer = transfer;
+        }
+      // DEAD TRANSFERS INTO SCRATCH
+      for(int b = 0; b < batch.size(); b++)
+        for(int s = 0; s < batch[b].size(); s++) {
+          std::vector<Transfer> transfer;
+          for(auto &t : batch[b][s].transfer) {
+            bool read = (t.recv.buffer < 0);
+            for(int b1 = 0; b1 < batch.size() && !read; b1++)
+              for(int s1 = (b1 == b ? s : 0); s1 < batch[b1].size() && !read; s1++) {
+                for(auto &t1 : batch[b1][s1].transfer)
+                  if(overlap(t1.sendid, t1.send, t1.count, t.recvid, t.recv, t.count))
+                    read = true;
+                for(auto &r : batch[b1][s1].reduce)
+                  for(auto &input : r.input)
+                    if(overlap(r.compid, input, r.count, t.recvid, t.recv, t.count))
+                      read = true;
+              }
+            if(read)
+              transfer.push_back(t);
+            else
+              numelim++;
+          }
+          batch[b][s].transfer = transfer;
+        }
+      prune();
+      return numelim;
+    }
+
+    // THE SAME DATA SENT TO THE SAME PROCESS MORE THAN ONCE IN A STEP (ACROSS PRIMITIVES) IS SENT ONCE AND COPIED
+    // LOCALLY IN A STEP INSERTED AFTER IT
+    int dedup_multicast() {
+      int numdedup = 0;
+      for(auto &steps : batch)
+        for(int s = 0; s < steps.size(); s++) {
+          std::vector<Transfer> transfer;
+          std::vector<Transfer> local;
+          for(auto &t : steps[s].transfer) {
+            bool dedup = false;
+            if(t.sendid != t.recvid)
+              for(auto &t1 : transfer)
+                if(t1.sendid == t.sendid && t1.recvid == t.recvid && t1.count == t.count && t1.send.buffer == t.send.buffer && t1.send.offset == t.send.offset) {
+                  // THE FIRST COPY MUST SURVIVE THE REDUCTIONS OF THE STEP, WHICH MUST NOT NEED THE SECOND
+                  bool safe = true;
+                  for(auto &r : steps[s].reduce) {
+                    if(overlap(r.compid, r.output, r.count, t1.recvid, t1.recv, t1.count))
+                      safe = false;
+                    for(auto &input : r.input)
+                      if(overlap(r.compid, input, r.count, t.recvid, t.recv, t.count))
+                        safe = false;
+                  }
+                  if(safe) {
+                    local.push_back({t.recvid, t1.recv, t.recvid, t.recv, t.count});
+                    dedup = true;
+                  }
+                  break;
+                }
+            if(dedup)
+              numdedup++;
+            else
+              transfer.push_back(t);
+          }
+          steps[s].transfer = transfer;
+          if(local.size()) {
+            Step step;
+            step.lib = steps[s].lib;
+            step.level = steps[s].level;
+            step.transfer = local;
+            steps.insert(steps.begin() + s + 1, step);
+            s++;
+          }
+        }
+      return numdedup;
+    }
+
+    void optimize(std::vector<int> &passes) {
+      for(auto &p : passes) {
+        int numchange = 0;
+        switch(p) {
+          case self_copy      : numchange = elide_self_copy();          break;
+          case redundant_copy : numchange = eliminate_redundant_copy(); break;
+          case multicast      : numchange = dedup_multicast();          break;
+          default : if(myid == printid) printf("unknown pass %d\n", p); continue;
+        }
+        if(myid == printid)
+          printf("pass %s: %d transfers\n", p == self_copy ? "self_copy" : (p == redundant_copy ? "redundant_copy" : "multicast"), numchange);
+      }
+    }
+  };